@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "../lib/scratch_arena.h"
+#include "distance.h"
+
+// Metric ball tree over the members of one cluster. Every node has a center, one of its members, and a radius, the largest distance from the center to a member.
+// A node is split by its member furthest from the center: members closer to that point than to the center go to the second child, which uses it as its center.
+// The first child keeps the center of its parent, so each split costs one row of distance calls. Positions refer to the order of the cluster vector
+
+struct BallTree {
+    struct Node {
+        size_t center;
+        float radius;
+        size_t begin;
+        size_t end;
+        // Node indices of the children, 0 for leaves since the root is never a child
+        std::array<size_t, 2> children = {0, 0};
+    };
+
+    std::vector<Node> nodes;
+    // Member positions ordered so every node covers the range [begin, end)
+    std::vector<size_t> order;
+    // Distance from order[i] to the center of the leaf holding it
+    std::vector<float> center_distances;
+
+    bool is_leaf(const Node& n) const { return n.children[0] == 0; }
+};
+
+template <typename T, typename F>
+BallTree build_ball_tree(const std::vector<T>& points, std::span<const size_t> cluster, F& dist_func, size_t leaf_size = 16) {
+    BallTree tree;
+    if (cluster.empty())
+        return tree;
+
+    tree.order.resize(cluster.size());
+    std::iota(tree.order.begin(), tree.order.end(), 0);
+    tree.center_distances.resize(cluster.size());
+    distances_to(dist_func, points[cluster[0]], points, cluster, tree.center_distances);
+
+    // Scratch for splitting a node, sized for the root
+    ScratchArena::Scope scratch;
+    auto ids = scratch.take<size_t>(cluster.size());
+    auto row = scratch.take<float>(cluster.size());
+    auto split_order = scratch.take<size_t>(cluster.size());
+    auto split_distances = scratch.take<float>(cluster.size());
+
+    // Builds the node covering [begin, end). order[begin] is its center and center_distances holds the distances to it
+    auto build = [&](auto& self, size_t begin, size_t end) -> size_t {
+        size_t node_index = tree.nodes.size();
+        tree.nodes.push_back({
+            .center = tree.order[begin],
+            .radius = *std::max_element(tree.center_distances.begin() + begin, tree.center_distances.begin() + end),
+            .begin = begin,
+            .end = end,
+        });
+
+        // All members at the center can not be split further
+        if (end - begin <= leaf_size || tree.nodes[node_index].radius == 0)
+            return node_index;
+
+        size_t far = std::distance(tree.center_distances.begin(), std::max_element(tree.center_distances.begin() + begin, tree.center_distances.begin() + end));
+
+        size_t size = end - begin;
+        for (size_t i = begin; i < end; i++)
+            ids[i - begin] = cluster[tree.order[i]];
+        distances_to(dist_func, points[cluster[tree.order[far]]], points, ids.first(size), row.first(size));
+
+        // Members closer to the far point move to the second child, the far point goes first there so it becomes its center
+        size_t split_size = 0;
+        auto push_split = [&](size_t position, float dist) {
+            split_order[split_size] = position;
+            split_distances[split_size] = dist;
+            split_size++;
+        };
+        for (size_t i = begin; i < end; i++) {
+            if (row[i - begin] >= tree.center_distances[i])
+                push_split(tree.order[i], tree.center_distances[i]);
+        }
+        size_t mid = begin + split_size;
+        push_split(tree.order[far], 0);
+        for (size_t i = begin; i < end; i++) {
+            if (row[i - begin] < tree.center_distances[i] && i != far)
+                push_split(tree.order[i], row[i - begin]);
+        }
+        std::copy_n(split_order.begin(), size, tree.order.begin() + begin);
+        std::copy_n(split_distances.begin(), size, tree.center_distances.begin() + begin);
+
+        size_t first = self(self, begin, mid);
+        size_t second = self(self, mid, end);
+        tree.nodes[node_index].children = {first, second};
+
+        return node_index;
+    };
+    build(build, 0, cluster.size());
+
+    return tree;
+}
+
+// Closest pair between the members of two clusters, found with a dual tree traversal over their ball trees. A pair of nodes is skipped when
+// d(c_a, c_b) - r_a - r_b is above the best distance so far, pairs of leaf members are skipped with the same bound from their distances to the leaf centers.
+// Ties are broken towards the lowest position in a, then in b, which is the pair a scan over a and then b returns. Returns (position in a, position in b, distance)
+template <typename T, typename F>
+std::tuple<size_t, size_t, float> closest_pair(const std::vector<T>& points,
+                                               std::span<const size_t> cluster_a,
+                                               const BallTree& tree_a,
+                                               std::span<const size_t> cluster_b,
+                                               const BallTree& tree_b,
+                                               F& dist_func) {
+    size_t best_a = 0;
+    size_t best_b = 0;
+    float best = INFINITY;
+
+    auto consider = [&](size_t a, size_t b, float dist) {
+        if (dist < best || (dist == best && std::make_pair(a, b) < std::make_pair(best_a, best_b))) {
+            best = dist;
+            best_a = a;
+            best_b = b;
+        }
+    };
+
+    // Bounds are only trusted up to a small relative slack, so rounding in the distances never drops a tied or better pair
+    auto ruled_out = [&](float lower_bound, float scale) { return lower_bound - 1e-5f * scale > best; };
+
+    size_t pruned = 0;
+
+    auto visit = [&](auto& self, size_t node_a, size_t node_b, float center_dist) -> void {
+        auto& a = tree_a.nodes[node_a];
+        auto& b = tree_b.nodes[node_b];
+
+        consider(a.center, b.center, center_dist);
+
+        if (ruled_out(center_dist - a.radius - b.radius, center_dist + a.radius + b.radius)) {
+            pruned += (a.end - a.begin) * (b.end - b.begin);
+            return;
+        }
+
+        if (tree_a.is_leaf(a) && tree_b.is_leaf(b)) {
+            for (size_t i = a.begin; i < a.end; i++) {
+                for (size_t j = b.begin; j < b.end; j++) {
+                    float da = tree_a.center_distances[i];
+                    float db = tree_b.center_distances[j];
+                    if (ruled_out(center_dist - da - db, center_dist + da + db)) {
+                        pruned++;
+                        continue;
+                    }
+
+                    size_t pa = tree_a.order[i];
+                    size_t pb = tree_b.order[j];
+                    consider(pa, pb, distance_bounded(dist_func, points[cluster_a[pa]], points[cluster_b[pb]], std::nextafter(best, INFINITY)));
+                }
+            }
+            return;
+        }
+
+        // Split the larger node, the first child shares the center so its center distance is already known. The closer child is visited first
+        bool split_a = tree_b.is_leaf(b) || (!tree_a.is_leaf(a) && a.radius >= b.radius);
+        if (split_a) {
+            auto [first, second] = a.children;
+            float second_dist = dist_func(points[cluster_a[tree_a.nodes[second].center]], points[cluster_b[b.center]]);
+            if (second_dist - tree_a.nodes[second].radius < center_dist - tree_a.nodes[first].radius) {
+                self(self, second, node_b, second_dist);
+                self(self, first, node_b, center_dist);
+            } else {
+                self(self, first, node_b, center_dist);
+                self(self, second, node_b, second_dist);
+            }
+        } else {
+            auto [first, second] = b.children;
+            float second_dist = dist_func(points[cluster_a[a.center]], points[cluster_b[tree_b.nodes[second].center]]);
+            if (second_dist - tree_b.nodes[second].radius < center_dist - tree_b.nodes[first].radius) {
+                self(self, node_a, second, second_dist);
+                self(self, node_a, first, center_dist);
+            } else {
+                self(self, node_a, first, center_dist);
+                self(self, node_a, second, second_dist);
+            }
+        }
+    };
+
+    if (!tree_a.nodes.empty() && !tree_b.nodes.empty()) {
+        auto& root_a = tree_a.nodes[0];
+        auto& root_b = tree_b.nodes[0];
+        visit(visit, 0, 0, dist_func(points[cluster_a[root_a.center]], points[cluster_b[root_b.center]]));
+    }
+
+    if constexpr (requires { dist_func.count_pruned(pruned); })
+        dist_func.count_pruned(pruned);
+
+    return {best_a, best_b, best};
+}
+
+// Label shared by every member of a node, or mixed_label when its members differ. labels are the labels of the members by position
+constexpr size_t mixed_label = SIZE_MAX;
+
+inline std::vector<size_t> node_labels(const BallTree& tree, std::span<const size_t> labels) {
+    std::vector<size_t> res(tree.nodes.size());
+
+    // Children always come after their parent
+    for (size_t n = tree.nodes.size(); n-- > 0;) {
+        auto& node = tree.nodes[n];
+        if (tree.is_leaf(node)) {
+            res[n] = labels[tree.order[node.begin]];
+            for (size_t i = node.begin + 1; i < node.end; i++) {
+                if (labels[tree.order[i]] != res[n])
+                    res[n] = mixed_label;
+            }
+        } else {
+            auto [first, second] = node.children;
+            res[n] = res[first] == res[second] ? res[first] : mixed_label;
+        }
+    }
+
+    return res;
+}
+
+// Leaves the members with one label out of a search, nodes whose members all have that label are skipped without any distance calls
+struct ExcludedLabel {
+    std::span<const size_t> labels;
+    std::span<const size_t> node_labels;
+    size_t label;
+};
+
+// The m members closest to query, as (distance, position) pairs sorted by distance, ties go to the lower position. Nodes and leaf members are skipped once their
+// lower bound is above the mth best distance so far
+template <typename T, typename F>
+std::vector<std::pair<float, size_t>> nearest_members(
+    const std::vector<T>& points, std::span<const size_t> cluster, const BallTree& tree, const T& query, size_t m, F& dist_func, std::optional<ExcludedLabel> excluded = {}) {
+    // Max heap on (distance, position), the top is the worst of the current m
+    std::vector<std::pair<float, size_t>> heap;
+    if (m == 0 || tree.nodes.empty())
+        return heap;
+
+    auto node_excluded = [&](size_t node_index) { return excluded.has_value() && excluded->node_labels[node_index] == excluded->label; };
+    if (node_excluded(0))
+        return heap;
+
+    auto worst = [&]() { return heap.size() < m ? INFINITY : heap.front().first; };
+    auto consider = [&](size_t position, float dist) {
+        if (excluded.has_value() && excluded->labels[position] == excluded->label)
+            return;
+
+        std::pair<float, size_t> candidate = {dist, position};
+        if (heap.size() < m) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (candidate < heap.front()) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end());
+        }
+    };
+    auto ruled_out = [&](float lower_bound, float scale) { return lower_bound - 1e-5f * scale > worst(); };
+
+    // The center of a node has already been considered by the time it is visited
+    auto visit = [&](auto& self, size_t node_index, float center_dist) -> void {
+        auto& node = tree.nodes[node_index];
+
+        if (ruled_out(center_dist - node.radius, center_dist + node.radius))
+            return;
+
+        if (tree.is_leaf(node)) {
+            for (size_t i = node.begin + 1; i < node.end; i++) {
+                float d = tree.center_distances[i];
+                if (ruled_out(std::abs(center_dist - d), center_dist + d) || (excluded.has_value() && excluded->labels[tree.order[i]] == excluded->label))
+                    continue;
+                consider(tree.order[i], dist_func(query, points[cluster[tree.order[i]]]));
+            }
+            return;
+        }
+
+        auto [first, second] = node.children;
+        if (node_excluded(second)) {
+            if (!node_excluded(first))
+                self(self, first, center_dist);
+            return;
+        }
+
+        float second_dist = dist_func(query, points[cluster[tree.nodes[second].center]]);
+        consider(tree.nodes[second].center, second_dist);
+
+        if (second_dist - tree.nodes[second].radius < center_dist - tree.nodes[first].radius) {
+            self(self, second, second_dist);
+            if (!node_excluded(first))
+                self(self, first, center_dist);
+        } else {
+            if (!node_excluded(first))
+                self(self, first, center_dist);
+            self(self, second, second_dist);
+        }
+    };
+
+    float root_dist = dist_func(query, points[cluster[tree.nodes[0].center]]);
+    consider(tree.nodes[0].center, root_dist);
+    visit(visit, 0, root_dist);
+
+    std::sort_heap(heap.begin(), heap.end());
+    return heap;
+}
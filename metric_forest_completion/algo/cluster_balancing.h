@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "clustering.h"
+#include "k_centering.h"
+
+// Capacity constrained clustering. Splits every cluster that holds more than max_cluster_size points by running k-centering (farthest first) on the members of that cluster.
+// Pieces that are still too large are split again until every cluster fits. Cluster ids of existing clusters are kept, new pieces are appended. Returns the new cluster count
+
+template <typename T, typename F>
+size_t split_oversized_clusters(const std::vector<T>& points, Clustering& clustering, size_t cluster_count, size_t max_cluster_size, F& dist_func) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (max_cluster_size == 0)
+        abort();
+
+    std::vector<std::vector<size_t>> cluster_vecs(cluster_count);
+    for (size_t i = 0; i < points.size(); i++)
+        cluster_vecs[clustering.assignments[i]].push_back(i);
+
+    std::vector<size_t> oversized;
+    for (size_t i = 0; i < cluster_count; i++)
+        if (cluster_vecs[i].size() > max_cluster_size)
+            oversized.push_back(i);
+
+    while (!oversized.empty()) {
+        size_t cluster_index = oversized.back();
+        oversized.pop_back();
+
+        auto members = std::move(cluster_vecs[cluster_index]);
+        size_t pieces = (members.size() + max_cluster_size - 1) / max_cluster_size;
+
+        auto sub_clustering = k_centering_subset(points, members, pieces, dist_func);
+
+        std::vector<std::vector<size_t>> piece_vecs(pieces);
+        for (size_t i = 0; i < members.size(); i++)
+            piece_vecs[sub_clustering.assignments[i]].push_back(members[i]);
+        auto piece_centers = sub_clustering.centers;
+
+        // Members now belong to the center of their piece
+        if (!clustering.center_distances.empty()) {
+            for (size_t i = 0; i < members.size(); i++)
+                clustering.center_distances[members[i]] = sub_clustering.center_distances[i];
+        }
+
+        // All members are at the same location, farthest first cannot separate them so split by position instead. Every center distance stays 0
+        if (piece_vecs[0].size() == members.size()) {
+            for (auto& v : piece_vecs)
+                v.clear();
+            for (size_t i = 0; i < members.size(); i++)
+                piece_vecs[i / max_cluster_size].push_back(members[i]);
+            for (size_t i = 0; i < pieces; i++)
+                piece_centers[i] = piece_vecs[i].empty() ? 0 : piece_vecs[i].front();
+        }
+
+        // The first piece keeps the id of the cluster being split, empty pieces are dropped
+        bool first = true;
+        for (size_t piece_number = 0; piece_number < pieces; piece_number++) {
+            auto& piece = piece_vecs[piece_number];
+            if (piece.empty())
+                continue;
+
+            size_t piece_index = cluster_index;
+            if (!first) {
+                piece_index = cluster_count++;
+                cluster_vecs.emplace_back();
+            }
+            first = false;
+
+            for (auto p : piece)
+                clustering.assignments[p] = piece_index;
+
+            if (!clustering.centers.empty()) {
+                clustering.centers.resize(cluster_count);
+                clustering.centers[piece_index] = piece_centers[piece_number];
+            }
+
+            if (piece.size() > max_cluster_size)
+                oversized.push_back(piece_index);
+
+            cluster_vecs[piece_index] = std::move(piece);
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    clustering.runtime += std::chrono::duration<double, std::milli>(end - start).count();
+
+    return cluster_count;
+}
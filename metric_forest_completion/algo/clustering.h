@@ -1,9 +1,17 @@
 #pragma once
 
+#include <span>
 #include <vector>
 
 // Type representing a clustering as well as the time taken to cluster. assignments[i] represents the cluster index for the ith point
+// centers[c] is the point index of the center of cluster c and center_distances[i] is the distance from the ith point to the center of its cluster,
+// both are empty for clustering methods without centers
 struct Clustering {
     std::vector<size_t> assignments;
+    std::vector<size_t> centers;
+    std::vector<float> center_distances;
     double runtime;
-};
\ No newline at end of file
+};
+
+// Members of every cluster as point indices. The spans point into index storage owned elsewhere, such as the positions of a ClusterLayout
+using ClusterVecs = std::vector<std::span<const size_t>>;
\ No newline at end of file
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <concepts>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Batched distance interface. A distance function may provide
+//     void dist_many(const T& query, const std::vector<T>& points, std::span<const size_t> indices, std::span<float> out)
+// which writes the distance from query to points[indices[i]] into out[i]. Metrics can use it to vectorize or prefetch. Loops that need every distance of a row
+// (first rows of k-centering, rep generator rows, ball tree splits, MST_Implicit) go through distances_to, which falls back to scalar calls when a distance
+// function only provides operator()
+
+template <typename F, typename T>
+concept BatchedDistance = requires(const F& f, const T& query, const std::vector<T>& points, std::span<const size_t> indices, std::span<float> out) {
+    f.dist_many(query, points, indices, out);
+};
+
+template <typename T, typename F>
+void distances_to(const F& dist_func, const T& query, const std::vector<T>& points, std::span<const size_t> indices, std::span<float> out) {
+    if constexpr (BatchedDistance<F, T>) {
+        dist_func.dist_many(query, points, indices, out);
+    } else {
+        for (size_t i = 0; i < indices.size(); i++)
+            out[i] = dist_func(query, points[indices[i]]);
+    }
+}
+
+// Bounded distance interface. A distance function may provide
+//     float dist_bounded(const T& a, const T& b, float upper)
+// which returns the exact distance when it is below upper and any value >= upper otherwise. Metrics use it to stop as soon as the result cannot beat upper.
+// Loops that only keep a distance when it improves on a current best go through distance_bounded, find_closest or update_closest. These prefer, in order, lower
+// bounds, dist_bounded and dist_many, so a metric with both dist_bounded and dist_many only batches the full rows above
+
+template <typename F, typename T>
+concept BoundedDistance = requires(const F& f, const T& a, const T& b, float upper) {
+    { f.dist_bounded(a, b, upper) } -> std::convertible_to<float>;
+};
+
+template <typename T, typename F>
+float distance_bounded(const F& dist_func, const T& a, const T& b, float upper) {
+    if constexpr (BoundedDistance<F, T>)
+        return dist_func.dist_bounded(a, b, upper);
+    else
+        return dist_func(a, b);
+}
+
+// Lower bound interface. A distance function may provide a cheap per point signature and a lower bound on the distance computed from two signatures
+//     using Signature = ...;
+//     Signature signature(const T& p)
+//     float lower_bound(const Signature& a, const Signature& b)
+// The lower bound must never exceed the computed distance. CountingDistance precomputes the signatures of a point set with prepare_signatures, find_closest and
+// update_closest then skip every point whose lower bound already rules it out and count it as pruned instead of as a distance call
+
+template <typename F, typename T>
+concept LowerBoundedDistance = requires(const F& f, const T& p) {
+    typename F::Signature;
+    { f.signature(p) } -> std::same_as<typename F::Signature>;
+    { f.lower_bound(f.signature(p), f.signature(p)) } -> std::convertible_to<float>;
+};
+
+// Distance functions holding the signatures of a point set, looked up by point index
+template <typename F, typename T>
+concept SignatureTable = requires(const F& f, const T& query, size_t index) {
+    { f.has_signatures() } -> std::convertible_to<bool>;
+    { f.lower_bound_at(f.query_signature(query), index) } -> std::convertible_to<float>;
+    f.count_pruned(index);
+};
+
+// Per thread scratch space for one row of distances. Only valid until the next call on the same thread
+inline std::span<float> distance_scratch(size_t size) {
+    thread_local std::vector<float> buffer;
+    if (buffer.size() < size)
+        buffer.resize(size);
+    return {buffer.data(), size};
+}
+
+// Finds the point in indices closest to query that is closer than upper. Returns its position in indices and the distance, ties go to the first position.
+// When no point is closer than upper the distance is >= upper
+template <typename T, typename F>
+std::pair<size_t, float> find_closest(const F& dist_func, const T& query, const std::vector<T>& points, std::span<const size_t> indices, float upper = INFINITY) {
+    size_t res = 0;
+    float min = INFINITY;
+
+    if constexpr (SignatureTable<F, T>) {
+        if (dist_func.has_signatures()) {
+            auto query_signature = dist_func.query_signature(query);
+            size_t pruned = 0;
+
+            for (size_t i = 0; i < indices.size(); i++) {
+                float bound = std::min(min, upper);
+                if (dist_func.lower_bound_at(query_signature, indices[i]) >= bound) {
+                    pruned++;
+                    continue;
+                }
+
+                if (float dist = distance_bounded(dist_func, query, points[indices[i]], bound); dist < min) {
+                    min = dist;
+                    res = i;
+                }
+            }
+
+            dist_func.count_pruned(pruned);
+            return {res, min};
+        }
+    }
+
+    if constexpr (BoundedDistance<F, T>) {
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (float dist = dist_func.dist_bounded(query, points[indices[i]], std::min(min, upper)); dist < min) {
+                min = dist;
+                res = i;
+            }
+        }
+    } else {
+        auto row = distance_scratch(indices.size());
+        distances_to(dist_func, query, points, indices, row);
+
+        for (size_t i = 0; i < row.size(); i++) {
+            if (row[i] < min) {
+                min = row[i];
+                res = i;
+            }
+        }
+    }
+    return {res, min};
+}
+
+// A point of an index list together with its distance to every point of that list, used to prune with the triangle inequality
+struct Anchor {
+    size_t position;
+    std::span<const float> distances;
+};
+
+// find_closest for index lists with known anchor distances. The query is measured against the anchors first, then a point x is skipped whenever
+// |d(q, a) - d(a, x)| is above the best distance so far for some anchor a. Returns the same point and distance as find_closest
+template <typename T, typename F>
+std::pair<size_t, float>
+find_closest_anchored(const F& dist_func, const T& query, const std::vector<T>& points, std::span<const size_t> indices, std::span<const Anchor> anchors, float upper = INFINITY) {
+    size_t res = 0;
+    float min = INFINITY;
+
+    // Anchors are measured out of order, so ties are settled by position to match a scan in order
+    auto consider = [&](size_t i, float dist) {
+        if (dist < min || (dist == min && i < res)) {
+            min = dist;
+            res = i;
+        }
+    };
+
+    constexpr size_t max_anchors = 8;
+    std::array<float, max_anchors> anchor_distances;
+    anchors = anchors.first(std::min(anchors.size(), max_anchors));
+
+    for (size_t k = 0; k < anchors.size(); k++) {
+        anchor_distances[k] = dist_func(query, points[indices[anchors[k].position]]);
+        consider(anchors[k].position, anchor_distances[k]);
+    }
+
+    size_t pruned = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        float bound = std::min(min, upper);
+
+        // Small relative slack so rounding never skips a tied point
+        bool skip = false;
+        for (size_t k = 0; k < anchors.size() && !skip; k++) {
+            float lower_bound = std::abs(anchor_distances[k] - anchors[k].distances[i]);
+            skip = lower_bound - 1e-5f * (anchor_distances[k] + anchors[k].distances[i]) > bound;
+        }
+        if (skip) {
+            pruned++;
+            continue;
+        }
+
+        if (std::ranges::any_of(anchors, [&](const Anchor& a) { return a.position == i; }))
+            continue;
+
+        consider(i, distance_bounded(dist_func, query, points[indices[i]], std::nextafter(bound, INFINITY)));
+    }
+
+    if constexpr (requires { dist_func.count_pruned(pruned); })
+        dist_func.count_pruned(pruned);
+
+    return {res, min};
+}
+
+// Lowers cur[i] to the distance from query to points[indices[i]] where that is smaller, calling on_improve(i) for every lowered entry
+template <typename T, typename F, typename OnImprove>
+void update_closest(const F& dist_func, const T& query, const std::vector<T>& points, std::span<const size_t> indices, std::span<float> cur, OnImprove&& on_improve) {
+    if constexpr (SignatureTable<F, T>) {
+        if (dist_func.has_signatures()) {
+            auto query_signature = dist_func.query_signature(query);
+            size_t pruned = 0;
+
+            for (size_t i = 0; i < indices.size(); i++) {
+                if (dist_func.lower_bound_at(query_signature, indices[i]) >= cur[i]) {
+                    pruned++;
+                    continue;
+                }
+
+                if (float dist = distance_bounded(dist_func, query, points[indices[i]], cur[i]); dist < cur[i]) {
+                    cur[i] = dist;
+                    on_improve(i);
+                }
+            }
+
+            dist_func.count_pruned(pruned);
+            return;
+        }
+    }
+
+    if constexpr (BoundedDistance<F, T>) {
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (float dist = dist_func.dist_bounded(query, points[indices[i]], cur[i]); dist < cur[i]) {
+                cur[i] = dist;
+                on_improve(i);
+            }
+        }
+    } else {
+        auto row = distance_scratch(indices.size());
+        distances_to(dist_func, query, points, indices, row);
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (row[i] < cur[i]) {
+                cur[i] = row[i];
+                on_improve(i);
+            }
+        }
+    }
+}
+
+template <typename F>
+struct SignatureOf {
+    using Type = char;
+};
+
+template <typename F>
+requires requires { typename F::Signature; }
+struct SignatureOf<F> {
+    using Type = typename F::Signature;
+};
+
+// Wraps a distance function and counts the distance calls made through it, including the ones made in batches. Also counts the calls skipped by lower bounds,
+// and holds the signature table when the wrapped function has lower bounds. A wrapper around another CountingDistance uses the table of the wrapped one. The table
+// is shared, so counters made for parallel tasks can refer to the table of one point set without copying it
+template <typename F>
+struct CountingDistance {
+    const F& dist_func;
+    mutable std::atomic<size_t> calls = 0;
+    mutable std::atomic<size_t> pruned = 0;
+
+    std::shared_ptr<const std::vector<typename SignatureOf<F>::Type>> signatures;
+
+    template <typename T>
+    float operator()(const T& a, const T& b) const {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return dist_func(a, b);
+    }
+
+    template <typename T>
+    void dist_many(const T& query, const std::vector<T>& points, std::span<const size_t> indices, std::span<float> out) const {
+        calls.fetch_add(indices.size(), std::memory_order_relaxed);
+        distances_to(dist_func, query, points, indices, out);
+    }
+
+    template <typename T>
+    float dist_bounded(const T& a, const T& b, float upper) const requires BoundedDistance<F, T>
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return dist_func.dist_bounded(a, b, upper);
+    }
+
+    template <typename T>
+    void prepare_signatures(const std::vector<T>& points) requires LowerBoundedDistance<F, T>
+    {
+        auto table = std::make_shared<std::vector<typename SignatureOf<F>::Type>>(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+            (*table)[i] = dist_func.signature(points[i]);
+        signatures = std::move(table);
+    }
+
+    bool has_signatures() const {
+        if constexpr (requires { dist_func.has_signatures(); })
+            return dist_func.has_signatures();
+        else
+            return signatures && !signatures->empty();
+    }
+
+    template <typename T>
+    auto query_signature(const T& p) const requires(LowerBoundedDistance<F, T> || SignatureTable<F, T>)
+    {
+        if constexpr (SignatureTable<F, T>)
+            return dist_func.query_signature(p);
+        else
+            return dist_func.signature(p);
+    }
+
+    template <typename S>
+    float lower_bound_at(const S& query_signature, size_t index) const
+    requires(requires(const F& f, const S& s, size_t i) { f.lower_bound_at(s, i); } || requires(const F& f, const S& s) { f.lower_bound(s, s); })
+    {
+        if constexpr (requires { dist_func.lower_bound_at(query_signature, index); })
+            return dist_func.lower_bound_at(query_signature, index);
+        else
+            return dist_func.lower_bound(query_signature, (*signatures)[index]);
+    }
+
+    void count_pruned(size_t amount) const {
+        pruned.fetch_add(amount, std::memory_order_relaxed);
+        if constexpr (requires { dist_func.count_pruned(amount); })
+            dist_func.count_pruned(amount);
+    }
+
+    // Returns the calls made since the last take_calls and resets the count
+    size_t take_calls() const { return calls.exchange(0); }
+
+    // Returns the calls skipped by lower bounds since the last take_pruned and resets the count
+    size_t take_pruned() const { return pruned.exchange(0); }
+};
+
+template <typename F>
+CountingDistance(const F&) -> CountingDistance<F>;
@@ -2,106 +2,82 @@
 
 #include <algorithm>
 #include <chrono>
+#include <numeric>
 #include <vector>
 
 #include "clustering.h"
+#include "distance.h"
 
 // Implementation for the k-centering clustering algorithm
 
 template <typename T, typename F>
-Clustering k_centering(const std::vector<T>& points, size_t num_clusters, size_t inital_index, F dist_func) {
+Clustering k_centering(const std::vector<T>& points, size_t num_clusters, size_t inital_index, F& dist_func) {
     auto start = std::chrono::high_resolution_clock::now();
 
     if (points.size() < num_clusters)
         abort();
 
     if (num_clusters <= 1) {
-        return Clustering{.assignments = std::vector<size_t>(points.size(), 0), .runtime = 0};
+        return Clustering{.assignments = std::vector<size_t>(points.size(), 0), .centers = {inital_index}, .runtime = 0};
     }
 
-    auto closest_point = [&](T p, const std::vector<T>& points) {
-        size_t res = 0;
-        float dist = dist_func(p, points[0]);
-
-        for (size_t i = 1; i < points.size(); i++) {
-            auto cur_dist = dist_func(p, points[i]);
-            if (cur_dist < dist) {
-                dist = cur_dist;
-                res = i;
-            }
-        }
-
-        return res;
-    };
-
-    auto furthest_point = [&](T p, const std::vector<T>& points) {
-        size_t res = 0;
-        float dist = dist_func(p, points[0]);
-
-        for (size_t i = 1; i < points.size(); i++) {
-            auto cur_dist = dist_func(p, points[i]);
-            if (cur_dist > dist) {
-                dist = cur_dist;
-                res = i;
-            }
-        }
-
-        return res;
-    };
-
-    using DistType = decltype(dist_func(points[0], points[0]));
-
-    std::vector<T> centroids;
-    centroids.reserve(num_clusters);
-    centroids.push_back(points[inital_index]);
-
-    std::vector<DistType> cur_distances;
-    cur_distances.reserve(points.size());
-
-    size_t second_index = 0;
-    auto max_dist = dist_func(points[0], centroids[0]);
-
-    for (size_t i = 0; i < points.size(); i++) {
-        auto dist = dist_func(points[i], centroids[0]);
-        if (dist > max_dist) {
-            second_index = i;
-            max_dist = dist;
-        }
-        cur_distances.push_back(dist);
-    }
-    centroids.push_back(points[second_index]);
-
-    while (centroids.size() < num_clusters) {
-        size_t new_index = 0;
-        auto max_dist = std::min(dist_func(points[0], centroids.back()), cur_distances[0]);
-        cur_distances[0] = max_dist;
+    std::vector<size_t> all_indices(points.size());
+    std::iota(all_indices.begin(), all_indices.end(), 0);
 
-        for (size_t i = 1; i < points.size(); i++) {
-            auto dist = dist_func(points[i], centroids.back());
-            if (dist < cur_distances[i])
-                cur_distances[i] = dist;
+    // Distance from each point to its closest center so far. Assignments are updated as centers are added, so no final pass over the centers is needed
+    std::vector<float> cur_distances(points.size());
+    std::vector<size_t> assignments(points.size(), 0);
+    std::vector<size_t> centers = {inital_index};
 
-            if (cur_distances[i] > max_dist) {
-                max_dist = cur_distances[i];
-                new_index = i;
-            }
-        }
+    distances_to(dist_func, points[inital_index], points, all_indices, cur_distances);
 
-        centroids.push_back(points[new_index]);
-    }
+    auto furthest_point = [&]() { return std::distance(cur_distances.begin(), std::max_element(cur_distances.begin(), cur_distances.end())); };
 
-    std::vector<size_t> res;
-    res.reserve(points.size());
-    for (size_t i = 0; i < points.size(); i++) {
-        res.push_back(closest_point(points[i], centroids));
+    // Only distances below cur_distances matter, so bounded metrics can stop early
+    for (size_t center = 1; center < num_clusters; center++) {
+        centers.push_back(furthest_point());
+        update_closest(dist_func, points[centers.back()], points, all_indices, cur_distances, [&](size_t i) { assignments[i] = center; });
     }
 
     auto end = std::chrono::high_resolution_clock::now();
 
-    return Clustering{.assignments = res, .runtime = std::chrono::duration<double, std::milli>(end - start).count()};
+    return Clustering{
+        .assignments = assignments, .centers = centers, .center_distances = std::move(cur_distances), .runtime = std::chrono::duration<double, std::milli>(end - start).count()};
 }
 
 template <typename T, typename F>
-Clustering k_centering(const std::vector<T>& points, size_t num_clusters, F dist_func) {
+Clustering k_centering(const std::vector<T>& points, size_t num_clusters, F& dist_func) {
     return k_centering(points, num_clusters, points.size() / 2, dist_func);
 }
+
+// Runs k-centering on the subset of points given by indices, starting from indices[0]. The assignments and center distances in the result are for each entry of
+// indices and the assignments are local cluster indices, the centers are point indices
+template <typename T, typename F>
+Clustering k_centering_subset(const std::vector<T>& points, std::span<const size_t> indices, size_t num_clusters, F& dist_func) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (indices.size() < num_clusters)
+        abort();
+
+    std::vector<size_t> assignments(indices.size(), 0);
+    std::vector<size_t> centers = {indices[0]};
+
+    if (num_clusters <= 1)
+        return Clustering{.assignments = assignments, .centers = centers, .runtime = 0};
+
+    // Distance from each point to its closest center so far, assignments are updated as centers are added
+    std::vector<float> cur_distances(indices.size());
+    distances_to(dist_func, points[indices[0]], points, indices, cur_distances);
+
+    auto furthest_point = [&]() { return std::distance(cur_distances.begin(), std::max_element(cur_distances.begin(), cur_distances.end())); };
+
+    for (size_t center = 1; center < num_clusters; center++) {
+        centers.push_back(indices[furthest_point()]);
+        update_closest(dist_func, points[centers.back()], points, indices, cur_distances, [&](size_t i) { assignments[i] = center; });
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return Clustering{
+        .assignments = assignments, .centers = centers, .center_distances = std::move(cur_distances), .runtime = std::chrono::duration<double, std::milli>(end - start).count()};
+}
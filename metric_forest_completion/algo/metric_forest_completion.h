@@ -7,14 +7,18 @@
 template <typename T, typename DistFunc>
 MetricForestCompletion metric_forest_completion(std::vector<T> points, size_t cluster_count, std::vector<size_t> cluster_assignments, DistFunc dist_func) {
 
-    auto cluster_vecs = create_cluster_vecs(cluster_count, points, cluster_assignments);
-    auto [cluster_msts, sub_cluster_runtime] = sub_clusters(cluster_count, points, cluster_vecs, dist_func);
+    // Works on the points in cluster order, edges are mapped back to the original indices
+    auto layout = create_cluster_layout(cluster_count, points, cluster_assignments);
+    auto cluster_vecs = create_cluster_vecs(layout);
+    auto [cluster_forest, sub_cluster_runtime] = sub_clusters(cluster_count, points, cluster_vecs, dist_func);
     auto [unmapped_completion_edges, completion_edges_runtime] = get_unmapped_completion_edges_approx_simple(cluster_count, points, cluster_vecs, dist_func);
     auto [completion, completion_runtime] = get_completion(cluster_count, unmapped_completion_edges);
     auto completion_edges = map_completion_edges(completion);
+    cluster_forest = layout.restore(*cluster_forest);
+    layout.restore(completion_edges);
 
     MetricForestCompletion mfc{
-        .cluster_edges = cluster_msts,
+        .cluster_forest = cluster_forest,
         .completion_edges = completion_edges,
 
         .sub_cluster_runtime = sub_cluster_runtime,
@@ -3,266 +3,344 @@
 #include <cfloat>
 #include <cmath>
 
+#include "ball_tree.h"
 #include "metric_forest_completion_utils.h"
+#include "rep_generator.h"
+
+// Completion edges from reps that can be extended as clusters get more reps. Each pair keeps its best edge so far and only the reps it has not seen yet are
+// evaluated, so a sweep over increasing rep counts costs about as much as its largest point
+struct RepCompletionState {
+    std::vector<ClusterPair> pairs;
+    std::vector<CompletionEdge> edges;
+    // Reps of each cluster already included in edges
+    std::vector<size_t> reps_used;
+};
 
-template <typename T, typename F>
-std::tuple<std::vector<CompletionEdge>, double>
-get_unmapped_completion_edges_from_reps(std::vector<T>& points, std::vector<std::vector<size_t>>& cluster_vecs, std::vector<std::vector<std::pair<size_t, float>>>& rep_vecs, F& dist_func) {
-    size_t cluster_count = cluster_vecs.size();
-
-    std::vector<CompletionEdge> unmapped_completion_edges;
-    unmapped_completion_edges.reserve(cluster_count * (cluster_count - 1));
-
-    auto runtime = time_code([&]() {
-        for (size_t i = 0; i < cluster_count - 1; i++) {
-            for (size_t j = 1; j < cluster_count; j++) {
+inline RepCompletionState create_rep_completion_state(const ClusterVecs& cluster_vecs) {
+    RepCompletionState state;
+    state.pairs = all_cluster_pairs(cluster_vecs);
+    state.edges.resize(state.pairs.size());
+    for (size_t i = 0; i < state.pairs.size(); i++)
+        state.edges[i] = {.a = (EdgeIndex)state.pairs[i].a, .b = (EdgeIndex)state.pairs[i].b, .weight = INFINITY};
+    state.reps_used.resize(cluster_vecs.size(), 0);
+    return state;
+}
 
-                if (cluster_vecs[i].size() == 0 || cluster_vecs[j].size() == 0)
-                    continue;
+// Adds the reps of rep_vecs that are not in state yet. rep_vecs[i] must start with the reps previously passed for cluster i. Returns the runtime.
+// When rep_anchor(i, r) gives the distances from the rth rep of cluster i to its members, the first reps of each cluster are used as anchors to skip members
+// with the triangle inequality
+template <typename T, typename F, typename Reps, typename RepAnchor = std::nullptr_t>
+double extend_completion_edges_from_reps(
+    RepCompletionState& state, std::vector<T>& points, const ClusterVecs& cluster_vecs, std::vector<Reps>& rep_vecs, F& dist_func, RepAnchor rep_anchor = nullptr) {
+    return time_code([&]() {
+        auto new_reps = [&](size_t i) { return rep_vecs[i].size() - state.reps_used[i]; };
+
+        constexpr bool use_anchors = !std::is_null_pointer_v<RepAnchor>;
+
+        std::vector<std::vector<Anchor>> anchors(cluster_vecs.size());
+        if constexpr (use_anchors) {
+            for (size_t i = 0; i < cluster_vecs.size(); i++)
+                for (size_t r = 0; r < std::min<size_t>(rep_vecs[i].size(), 8); r++)
+                    anchors[i].push_back(rep_anchor(i, r));
+        }
 
-                CompletionEdge e;
-                e.a = i;
-                e.b = j;
-                e.weight = INFINITY;
-
-                for (size_t k = 0; k < cluster_vecs[j].size(); k++) {
-                    for (auto [i_rep, cost] : rep_vecs[i]) {
-                        auto dist = dist_func(points[i_rep], points[cluster_vecs[j][k]]);
-                        if (dist < e.weight) {
-                            e.a_rep = i_rep;
-                            e.b_rep = cluster_vecs[j][k];
-                            e.weight = dist;
-                        }
+        auto closest = [&](size_t rep, size_t cluster, float upper) {
+            if constexpr (use_anchors)
+                return find_closest_anchored(dist_func, points[rep], points, cluster_vecs[cluster], anchors[cluster], upper);
+            else
+                return find_closest(dist_func, points[rep], points, cluster_vecs[cluster], upper);
+        };
+
+        state.edges = compute_pair_edges(
+            state.pairs,
+            [&](ClusterPair p) { return (double)new_reps(p.a) * cluster_vecs[p.b].size() + (double)new_reps(p.b) * cluster_vecs[p.a].size(); },
+            [&](ClusterPair p, size_t pair_index) {
+                size_t i = p.a;
+                size_t j = p.b;
+
+                // Start from the best edge of the reps already seen, new reps only replace it when they are strictly better
+                CompletionEdge e = state.edges[pair_index];
+
+                for (size_t r = state.reps_used[i]; r < rep_vecs[i].size(); r++) {
+                    size_t i_rep = rep_vecs[i][r].first;
+                    auto [k, dist] = closest(i_rep, j, e.weight);
+                    if (dist < e.weight) {
+                        e.a_rep = i_rep;
+                        e.b_rep = cluster_vecs[j][k];
+                        e.weight = dist;
                     }
                 }
 
-                for (size_t k = 0; k < cluster_vecs[i].size(); k++) {
-                    for (auto [j_rep, cost] : rep_vecs[j]) {
-                        auto dist = dist_func(points[cluster_vecs[i][k]], points[j_rep]);
-                        if (dist < e.weight) {
-                            e.a_rep = cluster_vecs[i][k];
-                            e.b_rep = j_rep;
-                            e.weight = dist;
-                        }
+                for (size_t r = state.reps_used[j]; r < rep_vecs[j].size(); r++) {
+                    size_t j_rep = rep_vecs[j][r].first;
+                    auto [k, dist] = closest(j_rep, i, e.weight);
+                    if (dist < e.weight) {
+                        e.a_rep = cluster_vecs[i][k];
+                        e.b_rep = j_rep;
+                        e.weight = dist;
                     }
                 }
 
-                unmapped_completion_edges.push_back(e);
-            }
-        }
+                return e;
+            });
+
+        for (size_t i = 0; i < rep_vecs.size(); i++)
+            state.reps_used[i] = rep_vecs[i].size();
     });
+}
 
-    return std::make_tuple(unmapped_completion_edges, runtime);
+template <typename T, typename F, typename Reps, typename RepAnchor = std::nullptr_t>
+std::tuple<std::vector<CompletionEdge>, double> get_unmapped_completion_edges_from_reps(
+    std::vector<T>& points, const ClusterVecs& cluster_vecs, std::vector<Reps>& rep_vecs, F& dist_func, RepAnchor rep_anchor = nullptr) {
+    auto state = create_rep_completion_state(cluster_vecs);
+    auto runtime = extend_completion_edges_from_reps(state, points, cluster_vecs, rep_vecs, dist_func, rep_anchor);
+    return std::make_tuple(std::move(state.edges), runtime);
 };
 
-template <typename T, typename F>
-std::vector<std::pair<size_t, float>> get_best_reps(size_t cluster_count, std::vector<T>& points, std::vector<size_t>& cluster, size_t amount, F& dist_func) {
-    std::vector<std::pair<size_t, float>> reps;
-
-    if (amount <= 0)
-        return reps;
-
-    reps.reserve(amount);
-    reps.emplace_back(cluster[0], INFINITY);
-
-    std::vector<float> cur_distances;
-    cur_distances.reserve(points.size());
+// Sum of the two cluster sizes, the amount of distance calls the single rep completions make for a pair
+inline auto cluster_pair_size(const ClusterVecs& cluster_vecs) {
+    return [&](ClusterPair p) { return (double)(cluster_vecs[p.a].size() + cluster_vecs[p.b].size()); };
+}
 
-    {
-        size_t second_index = cluster[0];
-        auto max_dist = dist_func(points[cluster[0]], points[reps.back().first]);
+// Simple completion over the given cluster pairs
+template <typename T, typename F>
+std::tuple<std::vector<CompletionEdge>, double> get_unmapped_completion_edges_approx_simple(
+    size_t cluster_count, std::vector<T>& points, const ClusterVecs& cluster_vecs, F& dist_func, const std::vector<ClusterPair>& pairs) {
+    std::vector<CompletionEdge> unmapped_completion_edges;
 
-        for (size_t i = 0; i < cluster.size(); i++) {
-            auto dist = dist_func(points[cluster[i]], points[reps.back().first]);
-            if (dist > max_dist) {
-                second_index = cluster[i];
-                max_dist = dist;
+    auto runtime = time_code([&]() {
+        unmapped_completion_edges = compute_pair_edges(pairs, cluster_pair_size(cluster_vecs), [&](ClusterPair p) {
+            size_t i = p.a;
+            size_t j = p.b;
+
+            size_t i_rep = 0;
+            size_t j_rep = 0;
+
+            CompletionEdge e;
+            e.a = i;
+            e.b = j;
+            e.weight = INFINITY;
+
+            if (auto [k, dist] = find_closest(dist_func, points[cluster_vecs[i][i_rep]], points, cluster_vecs[j], e.weight); dist < e.weight) {
+                e.a_rep = cluster_vecs[i][i_rep];
+                e.b_rep = cluster_vecs[j][k];
+                e.weight = dist;
             }
-            cur_distances.push_back(dist);
-        }
-
-        reps.back().second = max_dist;
 
-        if (amount <= 1)
-            return reps;
-
-        reps.emplace_back(second_index, INFINITY);
-    }
-
-    while (reps.size() <= amount) {
-        size_t new_index = cluster[0];
-        auto max_dist = std::min(dist_func(points[cluster[0]], points[reps.back().first]), cur_distances[0]);
-        cur_distances[0] = max_dist;
-
-        for (size_t i = 1; i < cluster.size(); i++) {
-            auto dist = dist_func(points[cluster[i]], points[reps.back().first]);
-            if (dist < cur_distances[i])
-                cur_distances[i] = dist;
-
-            if (cur_distances[i] > max_dist) {
-                max_dist = cur_distances[i];
-                new_index = cluster[i];
+            if (auto [k, dist] = find_closest(dist_func, points[cluster_vecs[j][j_rep]], points, cluster_vecs[i], e.weight); dist < e.weight) {
+                e.a_rep = cluster_vecs[i][k];
+                e.b_rep = cluster_vecs[j][j_rep];
+                e.weight = dist;
             }
-        }
-
-        reps.back().second = max_dist;
 
-        if (reps.size() == amount)
-            return reps;
+            return e;
+        });
+    });
 
-        reps.emplace_back(new_index, INFINITY);
-    }
+    return std::make_tuple(unmapped_completion_edges, runtime);
+};
 
-    return reps;
-}
+template <typename T, typename F>
+std::tuple<std::vector<CompletionEdge>, double>
+get_unmapped_completion_edges_approx_simple(size_t cluster_count, std::vector<T>& points, const ClusterVecs& cluster_vecs, F& dist_func) {
+    return get_unmapped_completion_edges_approx_simple(cluster_count, points, cluster_vecs, dist_func, all_cluster_pairs(cluster_vecs));
+};
 
 template <typename T, typename F>
 std::tuple<std::vector<CompletionEdge>, double>
-get_unmapped_completion_edges_approx_simple(size_t cluster_count, std::vector<T>& points, std::vector<std::vector<size_t>>& cluster_vecs, F& dist_func) {
+get_unmapped_completion_edges_approx_simple_plus_edge(size_t cluster_count, std::vector<T>& points, const ClusterVecs& cluster_vecs, F& dist_func) {
+    auto pairs = all_cluster_pairs(cluster_vecs);
+
     std::vector<CompletionEdge> unmapped_completion_edges;
-    unmapped_completion_edges.reserve(cluster_count * (cluster_count - 1));
 
     auto runtime = time_code([&]() {
-        for (size_t i = 0; i < cluster_count - 1; i++) {
-            for (size_t j = 1; j < cluster_count; j++) {
-
-                if (cluster_vecs[i].size() == 0 || cluster_vecs[j].size() == 0)
-                    continue;
-
-                size_t i_rep = 0;
-                size_t j_rep = 0;
-
-                CompletionEdge e;
-                e.a = i;
-                e.b = j;
-                e.weight = INFINITY;
+        unmapped_completion_edges = compute_pair_edges(pairs, cluster_pair_size(cluster_vecs), [&](ClusterPair p) {
+            size_t clust_i = p.a;
+            size_t clust_j = p.b;
+
+            size_t clust_i_rep = 0;
+            size_t clust_j_rep = 0;
+
+            CompletionEdge e1;
+            e1.a = clust_i;
+            e1.b = clust_j;
+            e1.weight = INFINITY;
+
+            if (auto [k, dist] = find_closest(dist_func, points[cluster_vecs[clust_i][clust_i_rep]], points, cluster_vecs[clust_j]); dist < e1.weight) {
+                e1.a_rep = cluster_vecs[clust_i][clust_i_rep];
+                e1.b_rep = cluster_vecs[clust_j][k];
+                e1.weight = dist;
+            }
 
-                for (size_t k = 0; k < cluster_vecs[j].size(); k++) {
-                    auto dist = dist_func(points[cluster_vecs[i][i_rep]], points[cluster_vecs[j][k]]);
-                    if (dist < e.weight) {
-                        e.a_rep = cluster_vecs[i][i_rep];
-                        e.b_rep = cluster_vecs[j][k];
-                        e.weight = dist;
-                    }
-                }
+            CompletionEdge e2;
+            e2.a = clust_i;
+            e2.b = clust_j;
+            e2.weight = INFINITY;
 
-                for (size_t k = 0; k < cluster_vecs[i].size(); k++) {
-                    auto dist = dist_func(points[cluster_vecs[i][k]], points[cluster_vecs[j][j_rep]]);
-                    if (dist < e.weight) {
-                        e.a_rep = cluster_vecs[i][k];
-                        e.b_rep = cluster_vecs[j][j_rep];
-                        e.weight = dist;
-                    }
-                }
+            if (auto [k, dist] = find_closest(dist_func, points[cluster_vecs[clust_j][clust_j_rep]], points, cluster_vecs[clust_i]); dist < e2.weight) {
+                e2.a_rep = cluster_vecs[clust_i][k];
+                e2.b_rep = cluster_vecs[clust_j][clust_j_rep];
+                e2.weight = dist;
+            }
 
-                unmapped_completion_edges.push_back(e);
+            CompletionEdge e;
+            if (e1.weight <= e2.weight)
+                e = e1;
+            else
+                e = e2;
+
+            if (float dist = distance_bounded(dist_func, points[e2.a_rep], points[e1.b_rep], e.weight); e.weight > dist) {
+                e = {
+                    .a = (EdgeIndex)clust_i,
+                    .b = (EdgeIndex)clust_j,
+                    .a_rep = e2.a_rep,
+                    .b_rep = e1.b_rep,
+                    .weight = dist,
+                };
             }
-        }
+
+            return e;
+        });
     });
 
     return std::make_tuple(unmapped_completion_edges, runtime);
 };
 
+// Exact completion over the given cluster pairs. Every cluster gets a ball tree, then the closest pair of every cluster pair is found with a dual tree traversal
+// instead of a full scan. Returns the same edges as scanning every member of i against every member of j
 template <typename T, typename F>
-std::tuple<std::vector<CompletionEdge>, double>
-get_unmapped_completion_edges_approx_simple_plus_edge(size_t cluster_count, std::vector<T>& points, std::vector<std::vector<size_t>>& cluster_vecs, F& dist_func) {
+std::tuple<std::vector<CompletionEdge>, double> get_unmapped_completion_edges_opt(
+    size_t cluster_count, std::vector<T>& points, const ClusterVecs& cluster_vecs, F& dist_func, const std::vector<ClusterPair>& pairs) {
     std::vector<CompletionEdge> unmapped_completion_edges;
-    unmapped_completion_edges.reserve(cluster_count * (cluster_count - 1));
 
     auto runtime = time_code([&]() {
-        for (size_t clust_i = 0; clust_i < cluster_count - 1; clust_i++) {
-            for (size_t clust_j = 1; clust_j < cluster_count; clust_j++) {
+        std::vector<BallTree> trees(cluster_vecs.size());
+        ThreadPool::global().parallel_for(cluster_vecs.size(), [&](size_t i) { trees[i] = build_ball_tree(points, cluster_vecs[i], dist_func); });
+
+        unmapped_completion_edges = compute_pair_edges(
+            pairs,
+            [&](ClusterPair p) { return (double)cluster_vecs[p.a].size() * cluster_vecs[p.b].size(); },
+            [&](ClusterPair p) {
+                auto [i, j, dist] = closest_pair(points, cluster_vecs[p.a], trees[p.a], cluster_vecs[p.b], trees[p.b], dist_func);
+
+                return CompletionEdge{
+                    .a = (EdgeIndex)p.a,
+                    .b = (EdgeIndex)p.b,
+                    .a_rep = (EdgeIndex)cluster_vecs[p.a][i],
+                    .b_rep = (EdgeIndex)cluster_vecs[p.b][j],
+                    .weight = dist,
+                };
+            });
+    });
 
-                if (cluster_vecs[clust_i].size() == 0 || cluster_vecs[clust_j].size() == 0)
-                    continue;
+    return std::make_tuple(unmapped_completion_edges, runtime);
+};
 
-                size_t clust_i_rep = 0;
-                size_t clust_j_rep = 0;
+template <typename T, typename F>
+std::tuple<std::vector<CompletionEdge>, double> get_unmapped_completion_edges_opt(size_t cluster_count, std::vector<T>& points, const ClusterVecs& cluster_vecs, F& dist_func) {
+    return get_unmapped_completion_edges_opt(cluster_count, points, cluster_vecs, dist_func, all_cluster_pairs(cluster_vecs));
+};
 
-                CompletionEdge e1;
-                e1.a = clust_i;
-                e1.b = clust_j;
-                e1.weight = INFINITY;
+// Sparse cluster pairs for the completion. Every cluster is paired with the clusters of its m nearest centers, found with a ball tree over the centers. When the
+// resulting cluster graph is disconnected, Boruvka rounds add the closest center pair leaving each component until the graph is connected, so a completion over
+// the pairs is always spanning. Those pairs are found with the same tree, each center searches for its nearest center in another component. Returns the pairs and
+// the runtime
+template <typename T, typename F>
+std::tuple<std::vector<ClusterPair>, double>
+center_knn_pairs(std::vector<T>& points, const ClusterVecs& cluster_vecs, const std::vector<size_t>& centers, size_t m, F& dist_func) {
+    std::vector<ClusterPair> pairs;
 
-                for (size_t k = 0; k < cluster_vecs[clust_j].size(); k++) {
-                    auto dist = dist_func(points[cluster_vecs[clust_i][clust_i_rep]], points[cluster_vecs[clust_j][k]]);
-                    if (dist < e1.weight) {
-                        e1.a_rep = cluster_vecs[clust_i][clust_i_rep];
-                        e1.b_rep = cluster_vecs[clust_j][k];
-                        e1.weight = dist;
-                    }
-                }
+    auto runtime = time_code([&]() {
+        // Only non empty clusters take part
+        std::vector<size_t> clusters;
+        std::vector<size_t> center_points;
+        for (size_t i = 0; i < cluster_vecs.size(); i++) {
+            if (!cluster_vecs[i].empty()) {
+                clusters.push_back(i);
+                center_points.push_back(centers[i]);
+            }
+        }
 
-                CompletionEdge e2;
-                e2.a = clust_i;
-                e2.b = clust_j;
-                e2.weight = INFINITY;
-
-                for (size_t k = 0; k < cluster_vecs[clust_i].size(); k++) {
-                    auto dist = dist_func(points[cluster_vecs[clust_i][k]], points[cluster_vecs[clust_j][clust_j_rep]]);
-                    if (dist < e2.weight) {
-                        e2.a_rep = cluster_vecs[clust_i][k];
-                        e2.b_rep = cluster_vecs[clust_j][clust_j_rep];
-                        e2.weight = dist;
-                    }
-                }
+        auto tree = build_ball_tree(points, center_points, dist_func);
 
-                CompletionEdge e;
-                if (e1.weight <= e2.weight)
-                    e = e1;
-                else
-                    e = e2;
-
-                if (float dist = dist_func(points[e2.a_rep], points[e1.b_rep]); e.weight > dist) {
-                    e = {
-                        .a = clust_i,
-                        .b = clust_j,
-                        .a_rep = e2.a_rep,
-                        .b_rep = e1.b_rep,
-                        .weight = dist,
-                    };
-                }
+        std::vector<std::vector<std::pair<float, size_t>>> neighbors(clusters.size());
+        ThreadPool::global().parallel_for(clusters.size(), [&](size_t i) {
+            // Plus one since every center finds itself
+            neighbors[i] = nearest_members(points, center_points, tree, points[center_points[i]], m + 1, dist_func);
+        });
 
-                unmapped_completion_edges.push_back(e);
+        for (size_t i = 0; i < clusters.size(); i++) {
+            for (auto [dist, j] : neighbors[i]) {
+                if (j != i)
+                    pairs.push_back({std::min(clusters[i], clusters[j]), std::max(clusters[i], clusters[j])});
             }
         }
-    });
-
-    return std::make_tuple(unmapped_completion_edges, runtime);
-};
-
-template <typename T, typename F>
-std::tuple<std::vector<CompletionEdge>, double> get_unmapped_completion_edges_opt(size_t cluster_count, std::vector<T>& points, std::vector<std::vector<size_t>>& cluster_vecs, F& dist_func) {
-    std::vector<CompletionEdge> unmapped_completion_edges;
-    unmapped_completion_edges.reserve(cluster_count * (cluster_count - 1));
 
-    auto runtime = time_code([&]() {
-        for (size_t clust_i = 0; clust_i < cluster_count - 1; clust_i++) {
-            for (size_t clust_j = 1; clust_j < cluster_count; clust_j++) {
+        // Components of the cluster graph, by position in clusters
+        std::vector<size_t> parent(clusters.size());
+        std::iota(parent.begin(), parent.end(), 0);
+        std::vector<size_t> position(cluster_vecs.size());
+        for (size_t i = 0; i < clusters.size(); i++)
+            position[clusters[i]] = i;
+
+        auto find = [&](size_t x) {
+            while (parent[x] != x)
+                x = parent[x] = parent[parent[x]];
+            return x;
+        };
+
+        size_t components = clusters.size();
+        auto join = [&](size_t a, size_t b) {
+            a = find(a);
+            b = find(b);
+            if (a != b) {
+                parent[b] = a;
+                components--;
+            }
+        };
+
+        for (auto p : pairs)
+            join(position[p.a], position[p.b]);
+
+        while (components > 1) {
+            // Nearest center outside its own component for every center, found with the center tree. Subtrees inside the component of the query are skipped
+            std::vector<size_t> component(clusters.size());
+            for (size_t i = 0; i < clusters.size(); i++)
+                component[i] = find(i);
+            auto component_nodes = node_labels(tree, component);
+
+            std::vector<std::pair<float, size_t>> nearest(clusters.size(), {INFINITY, 0});
+            ThreadPool::global().parallel_for(clusters.size(), [&](size_t i) {
+                auto res = nearest_members(points, center_points, tree, points[center_points[i]], 1, dist_func, ExcludedLabel{component, component_nodes, component[i]});
+                if (!res.empty())
+                    nearest[i] = res[0];
+            });
+
+            // Closest center pair leaving each component, (distance, i, j) by position
+            std::vector<std::tuple<float, size_t, size_t>> best(clusters.size(), {INFINITY, 0, 0});
+            for (size_t i = 0; i < clusters.size(); i++) {
+                auto [dist, j] = nearest[i];
+                if (dist < std::get<0>(best[component[i]]))
+                    best[component[i]] = {dist, i, j};
+            }
 
-                if (cluster_vecs[clust_i].size() == 0 || cluster_vecs[clust_j].size() == 0)
+            size_t joined = 0;
+            for (auto [dist, i, j] : best) {
+                if (dist == INFINITY)
                     continue;
-
-                CompletionEdge e;
-                e.a = clust_i;
-                e.b = clust_j;
-                e.weight = INFINITY;
-
-                for (size_t i = 0; i < cluster_vecs[clust_i].size(); i++) {
-                    for (size_t j = 0; j < cluster_vecs[clust_j].size(); j++) {
-                        auto dist = dist_func(points[cluster_vecs[clust_i][i]], points[cluster_vecs[clust_j][j]]);
-                        if (dist < e.weight) {
-                            e.a_rep = cluster_vecs[clust_i][i];
-                            e.b_rep = cluster_vecs[clust_j][j];
-                            e.weight = dist;
-                        }
-                    }
-                }
-
-                unmapped_completion_edges.push_back(e);
+                pairs.push_back({std::min(clusters[i], clusters[j]), std::max(clusters[i], clusters[j])});
+                join(i, j);
+                joined++;
             }
+            // Every component has a nearest outside center while there are several, so each round joins at least two of them
+            if (joined == 0)
+                abort();
         }
+
+        std::ranges::sort(pairs, [](ClusterPair x, ClusterPair y) { return std::make_pair(x.a, x.b) < std::make_pair(y.a, y.b); });
+        auto [first, last] = std::ranges::unique(pairs, [](ClusterPair x, ClusterPair y) { return x.a == y.a && x.b == y.b; });
+        pairs.erase(first, last);
     });
 
-    return std::make_tuple(unmapped_completion_edges, runtime);
-};
+    return std::make_tuple(pairs, runtime);
+}
@@ -1,13 +1,55 @@
 #pragma once
 
+#include "clustering.h"
 #include "mst_implicit.h"
 
+#include "../lib/scratch_arena.h"
+#include "../lib/thread_pool.h"
+
+#include <algorithm>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <numeric>
 #include <ranges>
+#include <span>
 #include <vector>
 
+// Work done by one level of the recursive forest, see recursive_mfc.h
+struct RecursionLevel {
+    size_t subproblems = 0;
+    size_t points = 0;
+    double runtime = 0;
+    double completion_cost = 0;
+    size_t dist_calls = 0;
+};
+
+// Forest inside every cluster as one flat edge array, the edges of cluster c are edges[offsets[c]..offsets[c + 1]). Built once per clustering and shared read only
+// by every completion computed for it
+struct ClusterForest {
+    std::vector<WeightedEdge> edges;
+    std::vector<size_t> offsets;
+
+    size_t cluster_count() const { return offsets.size() - 1; }
+    std::span<const WeightedEdge> cluster(size_t c) const { return std::span(edges).subspan(offsets[c], offsets[c + 1] - offsets[c]); }
+};
+
+inline std::shared_ptr<const ClusterForest> create_cluster_forest(const std::vector<std::vector<WeightedEdge>>& cluster_msts) {
+    auto forest = std::make_shared<ClusterForest>();
+    forest->offsets.reserve(cluster_msts.size() + 1);
+    forest->offsets.push_back(0);
+    for (auto& mst : cluster_msts)
+        forest->offsets.push_back(forest->offsets.back() + mst.size());
+
+    forest->edges.reserve(forest->offsets.back());
+    for (auto& mst : cluster_msts)
+        forest->edges.insert(forest->edges.end(), mst.begin(), mst.end());
+
+    return forest;
+}
+
 struct MetricForestCompletion {
-    std::vector<std::vector<WeightedEdge>> cluster_edges;
+    std::shared_ptr<const ClusterForest> cluster_forest;
     std::vector<WeightedEdge> completion_edges;
 
     size_t rep_count = 0;
@@ -22,18 +64,95 @@ struct MetricForestCompletion {
     size_t clustering_dist_calls = 0;
     size_t sub_cluster_dist_calls = 0;
     size_t mfc_dist_calls = 0;
+    // Distance calls the completion skipped because a lower bound ruled them out
+    size_t mfc_pruned_dist_calls = 0;
+    // Most scratch arena bytes one thread held at once while working for the completion
+    size_t scratch_high_water = 0;
+
+    // Levels below the top clustering that were solved recursively. Empty when every cluster used an exact MST
+    std::vector<RecursionLevel> recursion_levels;
 };
 
-struct CompletionEdge {
-    size_t a;
-    size_t b;
+// Edge between clusters a and b, realized by the points a_rep and b_rep
+template <typename Index>
+struct BasicCompletionEdge {
+    Index a;
+    Index b;
 
-    size_t a_rep;
-    size_t b_rep;
+    Index a_rep;
+    Index b_rep;
 
     float weight;
 };
 
+using CompletionEdge = BasicCompletionEdge<EdgeIndex>;
+
+// Unordered pair of clusters that a completion edge is computed for, a < b
+struct ClusterPair {
+    size_t a;
+    size_t b;
+};
+
+// Every unordered pair of non empty clusters, each pair exactly once
+inline std::vector<ClusterPair> all_cluster_pairs(const ClusterVecs& cluster_vecs) {
+    std::vector<ClusterPair> pairs;
+    pairs.reserve(cluster_vecs.size() * (cluster_vecs.size() - 1) / 2);
+
+    for (size_t i = 0; i < cluster_vecs.size(); i++) {
+        if (cluster_vecs[i].size() == 0)
+            continue;
+        for (size_t j = i + 1; j < cluster_vecs.size(); j++) {
+            if (cluster_vecs[j].size() == 0)
+                continue;
+            pairs.push_back({i, j});
+        }
+    }
+
+    return pairs;
+}
+
+// Computes edge_for_pair(pair) (or edge_for_pair(pair, pair_index)) for every pair on the global thread pool. Pairs are sorted by their weight (estimated work) and handed out largest first in chunks of
+// roughly equal total weight. Results are stored by pair index, so the output does not depend on scheduling
+template <typename W, typename F>
+std::vector<CompletionEdge> compute_pair_edges(const std::vector<ClusterPair>& pairs, W weight, F edge_for_pair) {
+    std::vector<CompletionEdge> edges(pairs.size());
+
+    ScratchArena::Scope scratch;
+
+    auto order = scratch.take<std::pair<double, size_t>>(pairs.size());
+    double total_weight = 0;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        order[i] = {weight(pairs[i]), i};
+        total_weight += order[i].first;
+    }
+    std::sort(order.begin(), order.end(), [](auto& a, auto& b) { return a.first > b.first; });
+
+    auto& pool = ThreadPool::global();
+    double chunk_weight = total_weight / (16.0 * std::max<size_t>(pool.thread_count(), 1));
+
+    std::vector<std::pair<size_t, size_t>> chunks;
+    for (size_t begin = 0; begin < order.size();) {
+        size_t end = begin;
+        double cur_weight = 0;
+        while (end < order.size() && (end == begin || cur_weight + order[end].first <= chunk_weight))
+            cur_weight += order[end++].first;
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+
+    pool.parallel_for(chunks.size(), [&](size_t c) {
+        for (size_t i = chunks[c].first; i < chunks[c].second; i++) {
+            size_t pair_index = order[i].second;
+            if constexpr (std::invocable<F, ClusterPair, size_t>)
+                edges[pair_index] = edge_for_pair(pairs[pair_index], pair_index);
+            else
+                edges[pair_index] = edge_for_pair(pairs[pair_index]);
+        }
+    });
+
+    return edges;
+}
+
 template <typename F>
 double time_code(F f) {
     auto start = std::chrono::high_resolution_clock::now();
@@ -50,48 +169,123 @@ auto time_code_ret(F f) {
     return std::tuple<double, decltype(res)>{std::chrono::duration<double, std::milli>(end - start).count(), res};
 }
 
+// Points permuted so every cluster is one contiguous range of positions, cluster c covers [offsets[c], offsets[c + 1]). Members keep their relative order, so
+// algorithms over the permuted points make the same choices as over the original ones while streaming through memory, and only their edges are mapped back
+struct ClusterLayout {
+    std::vector<size_t> offsets;
+    // order[p] is the original index of the point at position p, position[i] is the position of original point i
+    std::vector<size_t> order;
+    std::vector<size_t> position;
+    // Every position in order, the members of every cluster are a range of it
+    std::vector<size_t> positions;
+
+    // The clustering with point indices replaced by positions
+    Clustering permute(const Clustering& clustering) const {
+        Clustering res{.runtime = clustering.runtime};
+        res.assignments.resize(order.size());
+        for (size_t p = 0; p < order.size(); p++)
+            res.assignments[p] = clustering.assignments[order[p]];
+        for (auto c : clustering.centers)
+            res.centers.push_back(position[c]);
+        if (!clustering.center_distances.empty()) {
+            res.center_distances.resize(order.size());
+            for (size_t p = 0; p < order.size(); p++)
+                res.center_distances[p] = clustering.center_distances[order[p]];
+        }
+        return res;
+    }
+
+    // Replaces positions with original point indices
+    void restore(std::span<WeightedEdge> edges) const {
+        for (auto& e : edges) {
+            e.a = order[e.a];
+            e.b = order[e.b];
+        }
+    }
+
+    std::shared_ptr<const ClusterForest> restore(const ClusterForest& forest) const {
+        auto res = std::make_shared<ClusterForest>(forest);
+        restore(res->edges);
+        return res;
+    }
+};
+
+// Permutes points in place into cluster order with a counting sort over the assignments
 template <typename T>
-std::vector<std::vector<size_t>> create_cluster_vecs(size_t cluster_count, std::vector<T>& points, std::vector<size_t>& cluster_assignments) {
-    std::vector<std::vector<size_t>> cluster_vecs;
-    cluster_vecs.resize(cluster_count);
+ClusterLayout create_cluster_layout(size_t cluster_count, std::vector<T>& points, const std::vector<size_t>& cluster_assignments) {
+    require_edge_index(points.size());
 
+    ClusterLayout layout;
+    layout.offsets.assign(cluster_count + 1, 0);
+    for (auto c : cluster_assignments)
+        layout.offsets[c + 1]++;
+    for (size_t c = 0; c < cluster_count; c++)
+        layout.offsets[c + 1] += layout.offsets[c];
+
+    layout.order.resize(points.size());
+    layout.position.resize(points.size());
+    layout.positions.resize(points.size());
+    std::iota(layout.positions.begin(), layout.positions.end(), 0);
+    std::vector<size_t> next(layout.offsets.begin(), layout.offsets.end() - 1);
     for (size_t i = 0; i < points.size(); i++) {
-        auto assign = cluster_assignments[i];
-        cluster_vecs[assign].push_back(i);
+        size_t p = next[cluster_assignments[i]]++;
+        layout.order[p] = i;
+        layout.position[i] = p;
     }
 
+    std::vector<T> permuted;
+    permuted.reserve(points.size());
+    for (auto i : layout.order)
+        permuted.push_back(std::move(points[i]));
+    points = std::move(permuted);
+
+    return layout;
+}
+
+// Cluster vectors of a layout, every cluster is the run of positions [offsets[c], offsets[c + 1]). The spans point into the layout, which must outlive them
+inline ClusterVecs create_cluster_vecs(const ClusterLayout& layout) {
+    ClusterVecs cluster_vecs(layout.offsets.size() - 1);
+    for (size_t c = 0; c < cluster_vecs.size(); c++)
+        cluster_vecs[c] = std::span(layout.positions).subspan(layout.offsets[c], layout.offsets[c + 1] - layout.offsets[c]);
     return cluster_vecs;
-};
+}
 
+// Exact MST of every cluster, computed in parallel over the clusters. Edge endpoints are point indices
 template <typename T, typename F>
-std::tuple<std::vector<std::vector<WeightedEdge>>, double> sub_clusters(size_t cluster_count, std::vector<T>& points, std::vector<std::vector<size_t>>& cluster_vecs, F& dist_func) {
+std::tuple<std::shared_ptr<const ClusterForest>, double> sub_clusters(size_t cluster_count, std::vector<T>& points, const ClusterVecs& cluster_vecs, F& dist_func) {
     std::vector<std::vector<WeightedEdge>> cluster_msts;
     cluster_msts.resize(cluster_count);
+    std::shared_ptr<const ClusterForest> forest;
 
     auto runtime = time_code([&]() {
-        for (size_t i = 0; i < cluster_count; i++) {
-            cluster_msts[i] = [&]() {
-                auto res = MST_Implicit(cluster_vecs[i], [&](size_t a, size_t b) { return dist_func(points[a], points[b]); });
-                for (auto& e : res) {
-                    e.a = cluster_vecs[i][e.a];
-                    e.b = cluster_vecs[i][e.b];
-                }
-                return res;
-            }();
-        }
+        // An exact MST costs |C|^2 distance calls, so the largest clusters are submitted first and the pool balances the rest around them
+        std::vector<size_t> order(cluster_count);
+        std::iota(order.begin(), order.end(), 0);
+        std::ranges::stable_sort(order, std::greater{}, [&](size_t i) { return cluster_vecs[i].size(); });
+
+        ThreadPool::global().parallel_for(cluster_count, [&](size_t task) {
+            size_t i = order[task];
+            cluster_msts[i] = MST_Implicit(points, cluster_vecs[i], dist_func);
+            for (auto& e : cluster_msts[i]) {
+                e.a = cluster_vecs[i][e.a];
+                e.b = cluster_vecs[i][e.b];
+            }
+        });
+
+        forest = create_cluster_forest(cluster_msts);
     });
 
-    return std::make_tuple(cluster_msts, runtime);
+    return std::make_tuple(forest, runtime);
 };
 
-std::tuple<std::vector<CompletionEdge>, double> get_completion(size_t cluster_count, std::vector<CompletionEdge> unmapped_completion_edges) {
+std::tuple<std::vector<CompletionEdge>, double> get_completion(size_t cluster_count, const std::vector<CompletionEdge>& unmapped_completion_edges) {
     std::vector<CompletionEdge> completion;
     auto runtime = time_code([&]() { completion = MST(cluster_count, unmapped_completion_edges); });
     return std::make_tuple(completion, runtime);
 };
 
-std::vector<WeightedEdge> map_completion_edges(std::vector<CompletionEdge> completion) {
-    return std::ranges::to<std::vector>(completion | std::views::transform([&](CompletionEdge e) {
+std::vector<WeightedEdge> map_completion_edges(const std::vector<CompletionEdge>& completion) {
+    return std::ranges::to<std::vector>(completion | std::views::transform([&](const CompletionEdge& e) {
                                             return WeightedEdge{
                                                 .weight = e.weight,
                                                 .a = e.a_rep,
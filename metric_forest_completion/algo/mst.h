@@ -1,10 +1,33 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "../lib/scratch_arena.h"
+
 // Computes OPT MST for a given graph. Edges are assumed to be a struct that contains a and b elements that are integers and a weight element that is a float. Nodes are assumed to be 0 indexed
 
+// Integer type of edge endpoints. 32 bits halve the size of edge lists and cover every dataset with fewer than 2^32 points, define MFC_WIDE_INDICES for larger ones
+#ifdef MFC_WIDE_INDICES
+using EdgeIndex = size_t;
+#else
+using EdgeIndex = uint32_t;
+#endif
+
+// Aborts when count items can not be addressed with EdgeIndex
+inline void require_edge_index(size_t count) {
+    if (count > std::numeric_limits<EdgeIndex>::max()) {
+        fprintf(stderr, "Error: %zu points do not fit in 32 bit edge indices, rebuild with -DMFC_WIDE_INDICES=ON\n", count);
+        abort();
+    }
+}
+
 template <typename T>
 concept EdgeType = requires(T t) {
     { t.weight } -> std::convertible_to<float>;
@@ -12,32 +35,55 @@ concept EdgeType = requires(T t) {
     { t.b } -> std::convertible_to<size_t>;
 };
 
+// Kruskal with a union find over the nodes. Only (weight, position) keys are sorted instead of the edges themselves, the key uses the index type of the edge so a
+// 32 bit edge sorts 8 byte keys. Ties keep the input order. Keys and the union find live in scratch memory
 template <EdgeType T>
-std::vector<T> MST(size_t num_nodes, std::vector<T> edges) {
-    std::sort(edges.begin(), edges.end(), [](T& e1, T& e2) { return e1.weight < e2.weight; });
+std::vector<T> MST(size_t num_nodes, const std::vector<T>& edges) {
+    using Index = std::remove_cvref_t<decltype(std::declval<T>().a)>;
+
+    struct Key {
+        float weight;
+        Index position;
+
+        bool operator<(const Key& other) const { return weight < other.weight || (weight == other.weight && position < other.position); }
+    };
+
+    if (edges.size() > std::numeric_limits<Index>::max())
+        abort();
 
-    std::vector<size_t> sets;
-    sets.reserve(num_nodes);
+    ScratchArena::Scope scratch;
+
+    auto keys = scratch.take<Key>(edges.size());
+    for (size_t i = 0; i < edges.size(); i++)
+        keys[i] = {edges[i].weight, (Index)i};
+    std::sort(keys.begin(), keys.end());
+
+    auto parent = scratch.take<Index>(num_nodes);
     for (size_t i = 0; i < num_nodes; i++)
-        sets.push_back(i);
+        parent[i] = i;
+
+    auto find = [&](Index x) {
+        while (parent[x] != x)
+            x = parent[x] = parent[parent[x]];
+        return x;
+    };
 
     std::vector<T> res;
-    res.reserve(num_nodes - 1);
+    res.reserve(num_nodes == 0 ? 0 : num_nodes - 1);
 
-    for (auto& e : edges) {
-        if (sets[e.a] == sets[e.b]) {
-            continue;
-        }
+    for (auto key : keys) {
+        if (res.size() + 1 >= num_nodes)
+            break;
 
-        auto old_set = sets[e.b];
-        auto new_set = sets[e.a];
+        auto& e = edges[key.position];
+        Index a = find(e.a);
+        Index b = find(e.b);
+        if (a == b)
+            continue;
 
+        parent[b] = a;
         res.push_back(e);
-
-        for (auto& s : sets)
-            if (s == old_set)
-                s = new_set;
     }
 
     return res;
-}
\ No newline at end of file
+}
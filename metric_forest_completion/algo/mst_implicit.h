@@ -1,43 +1,60 @@
 #pragma once
 
+#include <algorithm>
+#include <span>
+
+#include "distance.h"
 #include "mst.h"
 
-// Computes OPT MST for an implciit graph. Takes only a list of points and a distance function, returns a list of edges with their distances pre-calculated
+// Computes OPT MST for an implciit graph. Takes a list of points and a distance function, returns a list of edges with their distances pre-calculated
 
-struct WeightedEdge {
+template <typename Index>
+struct BasicWeightedEdge {
     float weight;
-    size_t a;
-    size_t b;
+    Index a;
+    Index b;
 };
 
+using WeightedEdge = BasicWeightedEdge<EdgeIndex>;
+
+// Edges held before the batch is reduced to its MST, 1 GiB of edges
+constexpr size_t mst_implicit_batch_limit = 1073741824 / sizeof(WeightedEdge);
+
+// Estimated peak bytes of MST_Implicit over n points: the edge batch and the sort keys and union find of MST
+constexpr size_t mst_implicit_footprint(size_t n) {
+    if (n < 2)
+        return 0;
+    size_t edges = std::min(n * (n - 1) / 2, mst_implicit_batch_limit + n);
+    return edges * (sizeof(WeightedEdge) + 2 * sizeof(EdgeIndex)) + n * (sizeof(WeightedEdge) + sizeof(EdgeIndex));
+}
+
+// Computes OPT MST for the points given by indices. Distances are computed one row at a time through the batched distance interface. Edge endpoints are positions in indices
 template <typename T, typename F>
-std::vector<WeightedEdge> MST_Implicit(std::vector<T> points, F dist_func) {
-    if (points.size() < 2)
+std::vector<WeightedEdge> MST_Implicit(const std::vector<T>& points, std::span<const size_t> indices, F& dist_func) {
+    if (indices.size() < 2)
         return {};
 
-    constexpr bool BATCHED = true;
+    require_edge_index(indices.size());
 
-    if constexpr (BATCHED) {
-        std::vector<WeightedEdge> edges;
-        for (size_t i = 0; i < points.size() - 1; i++) {
-            for (size_t j = i + 1; j < points.size(); j++) {
-                edges.push_back({dist_func(points[i], points[j]), i, j});
-            }
+    // The edge list grows as rows are added, doubling up to the most a batch can hold, so small clusters never hold the full batch
+    size_t max_edges = std::min(indices.size() * (indices.size() - 1) / 2, mst_implicit_batch_limit + indices.size());
+    std::vector<WeightedEdge> edges;
+    for (size_t i = 0; i < indices.size() - 1; i++) {
+        auto row = distance_scratch(indices.size() - i - 1);
+        distances_to(dist_func, points[indices[i]], points, indices.subspan(i + 1), row);
 
-            if (edges.size() > 1073741824 / sizeof(WeightedEdge))
-                edges = MST(points.size(), edges);
-        }
+        if (edges.size() + row.size() > edges.capacity())
+            edges.reserve(std::min(std::max(2 * edges.capacity(), edges.size() + row.size()), max_edges));
 
-        edges = MST(points.size(), edges);
-        return edges;
-    } else {
-        std::vector<WeightedEdge> all_edges;
-        for (size_t i = 0; i < points.size() - 1; i++) {
-            for (size_t j = i + 1; j < points.size(); j++) {
-                all_edges.push_back({dist_func(points[i], points[j]), i, j});
-            }
-        }
+        for (size_t j = 0; j < row.size(); j++)
+            edges.push_back({row[j], (EdgeIndex)i, (EdgeIndex)(i + 1 + j)});
 
-        return MST(points.size(), all_edges);
+        // Keeps the capacity of edges for the next batch
+        if (edges.size() > mst_implicit_batch_limit) {
+            auto forest = MST(indices.size(), edges);
+            edges.assign(forest.begin(), forest.end());
+        }
     }
-}
\ No newline at end of file
+
+    return MST(indices.size(), edges);
+}
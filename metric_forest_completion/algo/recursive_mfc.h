@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "k_centering.h"
+#include "metric_forest_completion_functions.h"
+
+// Recursive (hierarchical) MFC. Clusters larger than leaf_size are not solved with an exact MST, instead they are clustered again with k ~ sqrt(|C|) and solved with MFC.
+// This continues until every sub problem has at most leaf_size points, giving an approximate forest with close to linear distance calls
+
+template <typename T, typename F>
+std::vector<WeightedEdge> recursive_forest(std::vector<T>& points, std::span<const size_t> indices, size_t depth, size_t leaf_size, std::vector<RecursionLevel>& levels, F& dist_func) {
+    auto exact_forest = [&]() {
+        auto res = MST_Implicit(points, indices, dist_func);
+        for (auto& e : res) {
+            e.a = indices[e.a];
+            e.b = indices[e.b];
+        }
+        return res;
+    };
+
+    if (indices.size() <= leaf_size)
+        return exact_forest();
+
+    if (levels.size() < depth)
+        levels.resize(depth);
+
+    // Distance calls made by this level only, children count their own
+    CountingDistance<F> level_dist_func{dist_func};
+
+    size_t cluster_count = std::max<size_t>(2, std::sqrt(indices.size()));
+
+    auto [clustering_runtime, members] = time_code_ret([&]() {
+        auto clustering = k_centering_subset(points, indices, cluster_count, level_dist_func);
+
+        std::vector<std::vector<size_t>> res(cluster_count);
+        for (size_t i = 0; i < indices.size(); i++)
+            res[clustering.assignments[i]].push_back(indices[i]);
+        return res;
+    });
+
+    // All points are at the same location and cannot be separated, fall back to the exact forest
+    bool separated = std::ranges::all_of(members, [&](auto& v) { return v.size() < indices.size(); });
+    if (!separated) {
+        levels[depth - 1].dist_calls += level_dist_func.take_calls();
+        return exact_forest();
+    }
+
+    // Members of a sub problem are spread over the level, so they are held in vectors of their own
+    ClusterVecs cluster_vecs(members.begin(), members.end());
+
+    std::vector<WeightedEdge> edges;
+    edges.reserve(indices.size() - 1);
+
+    for (auto& v : cluster_vecs) {
+        auto sub_forest = recursive_forest(points, v, depth + 1, leaf_size, levels, dist_func);
+        edges.insert(edges.end(), sub_forest.begin(), sub_forest.end());
+    }
+
+    auto [unmapped_completion_edges, completion_edges_runtime] = get_unmapped_completion_edges_approx_simple(cluster_count, points, cluster_vecs, level_dist_func);
+    auto [completion, completion_runtime] = get_completion(cluster_count, unmapped_completion_edges);
+    auto completion_edges = map_completion_edges(completion);
+    edges.insert(edges.end(), completion_edges.begin(), completion_edges.end());
+
+    auto& level = levels[depth - 1];
+    level.subproblems++;
+    level.points += indices.size();
+    level.runtime += clustering_runtime + completion_edges_runtime + completion_runtime;
+    level.dist_calls += level_dist_func.take_calls();
+    for (auto& e : completion_edges)
+        level.completion_cost += e.weight;
+
+    return edges;
+}
+
+// Drop in replacement for sub_clusters that solves clusters above leaf_size recursively with MFC instead of an exact MST
+template <typename T, typename F>
+std::tuple<std::shared_ptr<const ClusterForest>, double, std::vector<RecursionLevel>>
+sub_clusters_recursive(size_t cluster_count, std::vector<T>& points, const ClusterVecs& cluster_vecs, size_t leaf_size, F& dist_func) {
+    std::vector<std::vector<WeightedEdge>> cluster_msts;
+    cluster_msts.resize(cluster_count);
+
+    std::vector<RecursionLevel> levels;
+    std::shared_ptr<const ClusterForest> forest;
+
+    auto runtime = time_code([&]() {
+        for (size_t i = 0; i < cluster_count; i++)
+            cluster_msts[i] = recursive_forest(points, cluster_vecs[i], 1, leaf_size, levels, dist_func);
+        forest = create_cluster_forest(cluster_msts);
+    });
+
+    return std::make_tuple(forest, runtime, levels);
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <span>
+#include <vector>
+
+#include "../lib/thread_pool.h"
+#include "rep_generator.h"
+
+// Splitting a rep budget between clusters. Every cluster always gets its first rep, the allocators decide how many reps each cluster gets on top of that.
+// The cost of a cluster with r reps is the cost reported by its generator for the first r reps
+
+// Greedy allocation. The budget is handed out one rep at a time to the cluster whose cost drops the most from its next rep, ties go to the lower cluster index.
+// Candidates are kept in a max-heap and a generator is only extended when its next rep is considered, so the work scales with the budget instead of
+// cluster_count * budget. Stops early when every cluster is covered. Returns the amount of reps for each cluster
+template <typename Gen>
+std::vector<size_t> allocate_reps_greedy(std::vector<Gen>& generators, size_t budget) {
+    std::vector<size_t> counts(generators.size(), 0);
+
+    auto cmp = [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first < b.first || (a.first == b.first && a.second > b.second); };
+    std::priority_queue<std::pair<float, size_t>, std::vector<std::pair<float, size_t>>, decltype(cmp)> heap(cmp);
+
+    // Pushes the cost decrease of taking the next rep of cluster c, if it has one
+    auto push_next = [&](size_t c) {
+        generators[c].extend(counts[c] + 1);
+        if (generators[c].size() <= counts[c])
+            return;
+
+        auto reps = generators[c].reps(counts[c] + 1);
+        heap.emplace(reps[counts[c] - 1].second - reps[counts[c]].second, c);
+    };
+
+    // Must include first rep from each comp
+    for (size_t c = 0; c < generators.size(); c++) {
+        generators[c].extend(1);
+        counts[c] = generators[c].reps(1).size();
+        if (counts[c] != 0)
+            push_next(c);
+    }
+
+    for (size_t reps_used = 0; reps_used < budget && !heap.empty(); reps_used++) {
+        size_t c = heap.top().second;
+        heap.pop();
+
+        counts[c]++;
+        push_next(c);
+    }
+
+    return counts;
+}
+
+// Whether the cost decrease of every additional rep is at most the decrease of the rep before it
+inline bool is_convex_rep_curve(std::span<const std::pair<size_t, float>> curve) {
+    for (size_t r = 2; r < curve.size(); r++) {
+        if (curve[r - 1].second - curve[r].second > curve[r - 2].second - curve[r - 1].second)
+            return false;
+    }
+    return true;
+}
+
+// Optimal allocation with a DP over clusters, row t holds the lowest summed cost of clusters 0..t for every budget. A row is the min-plus convolution of the
+// previous row with the cost curve of cluster t. Only the reps given to cluster t are stored per cell and the allocation is reconstructed at the end.
+// When the curve is convex the row is Monge, so the best split point is monotone in the budget and the row is solved by divide and conquer in O(B log B).
+// Other rows search every split in parallel over the budget, using that a curve is flat once its cluster is covered. Ties go to the most reps for cluster t.
+// curves[t] are the first budget + 1 reps of cluster t. Returns the amount of reps for each cluster
+inline std::vector<size_t> allocate_reps_dp(const std::vector<std::span<const std::pair<size_t, float>>>& curves, size_t budget) {
+    size_t T = curves.size();
+
+    // Must include first rep from each comp
+    std::vector<size_t> counts(T);
+    for (size_t t = 0; t < T; t++)
+        counts[t] = std::min<size_t>(curves[t].size(), 1);
+
+    if (T == 0 || budget == 0)
+        return counts;
+
+    size_t B = budget;
+
+    // Cost of cluster t with r extra reps, a covered cluster stays at its last cost
+    auto cost = [&](size_t t, size_t r) { return curves[t].empty() ? 0.0f : curves[t][std::min(r, curves[t].size() - 1)].second; };
+
+    std::vector<float> prev(B + 1); // B + 1 includes budget of zero
+    std::vector<float> cur(B + 1);
+    std::vector<uint32_t> extra_reps((B + 1) * T); // Budgets are bounded by N, which fits 32 bits for every dataset used
+    std::vector<size_t> prefix_argmin(B + 1);
+
+    for (size_t b = 0; b <= B; b++) {
+        prev[b] = cost(0, b);
+        extra_reps[b] = b;
+    }
+
+    for (size_t t = 1; t < T; t++) {
+        auto row = std::span(extra_reps).subspan(t * (B + 1), B + 1);
+
+        // Leftmost minimum of prev[i] + cost(t, b - i) over i in [lo, hi]
+        auto best_split = [&](size_t b, size_t lo, size_t hi) {
+            size_t res = lo;
+            float min = INFINITY;
+            for (size_t i = lo; i <= hi; i++) {
+                if (float c = prev[i] + cost(t, b - i); c < min) {
+                    min = c;
+                    res = i;
+                }
+            }
+            return std::make_pair(res, min);
+        };
+
+        if (is_convex_rep_curve(curves[t])) {
+            auto solve = [&](auto& self, ssize_t lo, ssize_t hi, size_t opt_lo, size_t opt_hi) -> void {
+                if (lo > hi)
+                    return;
+
+                size_t mid = (lo + hi) / 2;
+                auto [i, min] = best_split(mid, opt_lo, std::min(mid, opt_hi));
+                cur[mid] = min;
+                row[mid] = mid - i;
+
+                self(self, lo, (ssize_t)mid - 1, opt_lo, i);
+                self(self, mid + 1, hi, i, opt_hi);
+            };
+            solve(solve, 0, B, 0, B);
+        } else {
+            // Every split leaving at least flat_from reps for cluster t has the same cluster cost, only the smallest prev among them matters
+            size_t flat_from = std::max<size_t>(curves[t].size(), 1) - 1;
+            for (size_t i = 0; i <= B; i++)
+                prefix_argmin[i] = (i == 0 || prev[i] < prev[prefix_argmin[i - 1]]) ? i : prefix_argmin[i - 1];
+
+            size_t chunk_size = 64;
+            ThreadPool::global().parallel_for((B + chunk_size) / chunk_size, [&](size_t chunk) {
+                for (size_t b = chunk * chunk_size; b <= std::min(B, (chunk + 1) * chunk_size - 1); b++) {
+                    size_t lo = 0;
+                    float min = INFINITY;
+                    size_t min_index = 0;
+
+                    if (b >= flat_from) {
+                        lo = b - flat_from + 1;
+                        min_index = prefix_argmin[b - flat_from];
+                        min = prev[min_index] + cost(t, b - min_index);
+                    }
+
+                    if (auto [i, c] = best_split(b, lo, b); c < min) {
+                        min = c;
+                        min_index = i;
+                    }
+
+                    cur[b] = min;
+                    row[b] = b - min_index;
+                }
+            });
+        }
+
+        std::swap(prev, cur);
+    }
+
+    // Walk the stored choices back from the full budget
+    size_t b = B;
+    for (size_t t = T; t-- > 0;) {
+        size_t extra = extra_reps[t * (B + 1) + b];
+        counts[t] = std::min(extra + 1, curves[t].size());
+        b -= extra;
+    }
+
+    return counts;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <span>
+#include <vector>
+
+#include "clustering.h"
+#include "distance.h"
+
+// Where a farthest first traversal over the members of a cluster starts. position is the first rep as a position in the cluster vector. When distances is not
+// empty it holds the distances from that rep to every member, so the traversal does not compute them again
+struct RepSeed {
+    size_t position = 0;
+    std::vector<float> distances;
+};
+
+// Seeds that start every cluster from its center, reusing the center distances of the clustering. Clusters without a known center start from their first member
+inline std::vector<RepSeed> create_rep_seeds(const Clustering& clustering, const ClusterVecs& cluster_vecs) {
+    std::vector<RepSeed> seeds(cluster_vecs.size());
+    if (clustering.centers.size() != cluster_vecs.size() || clustering.center_distances.empty())
+        return seeds;
+
+    for (size_t c = 0; c < cluster_vecs.size(); c++) {
+        auto& cluster = cluster_vecs[c];
+        auto it = std::ranges::find(cluster, clustering.centers[c]);
+        if (it == cluster.end())
+            continue;
+
+        seeds[c].position = std::distance(cluster.begin(), it);
+        seeds[c].distances.resize(cluster.size());
+        for (size_t i = 0; i < cluster.size(); i++)
+            seeds[c].distances[i] = clustering.center_distances[cluster[i]];
+    }
+
+    return seeds;
+}
+
+// Incremental farthest first traversal over the members of a single cluster, starting from the seed. The rep sequence is prefix stable, so the generator is extended
+// on demand and every prefix is the traversal for that amount of reps. reps()[i].second is the largest distance from a member to the first i + 1 reps.
+// The sequence ends once every member is at distance 0 from a rep. The distance row from every rep to the cluster members is kept, along with the cumulative
+// distance calls and runtime, so callers can report the cost of any prefix as if it was computed on its own
+
+template <typename T, typename F>
+class RepGenerator {
+  public:
+    RepGenerator(const std::vector<T>& points, std::span<const size_t> cluster, const F& dist_func, RepSeed seed = {})
+        : m_points(points), m_cluster(cluster), m_dist_func(dist_func), m_seed_distances(std::move(seed.distances)), m_next(seed.position) {}
+
+    // Extends the sequence to amount reps, or until the cluster is covered
+    void extend(size_t amount) {
+        while (m_reps.size() < amount && !exhausted())
+            add_rep();
+    }
+
+    bool exhausted() const { return m_cluster.empty() || (!m_reps.empty() && m_reps.back().second == 0); }
+
+    size_t size() const { return m_reps.size(); }
+
+    // The first amount reps, fewer if the sequence ended before that
+    std::span<const std::pair<size_t, float>> reps(size_t amount) const { return std::span(m_reps).first(std::min(amount, m_reps.size())); }
+
+    // Distances from the ith rep to every member of the cluster, in cluster order
+    std::span<const float> row(size_t rep) const { return std::span(m_rows).subspan(rep * m_cluster.size(), m_cluster.size()); }
+
+    // The ith rep as a triangle inequality anchor over the cluster members
+    Anchor anchor(size_t rep) const { return {m_positions[rep], row(rep)}; }
+
+    // Cost of computing the first amount reps
+    size_t dist_calls(size_t amount) const { return amount == 0 ? 0 : m_cumulative_dist_calls[std::min(amount, m_reps.size()) - 1]; }
+    double runtime(size_t amount) const { return amount == 0 ? 0 : m_cumulative_runtime[std::min(amount, m_reps.size()) - 1]; }
+
+  private:
+    void add_rep() {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        size_t pos = m_next;
+        // The first rep of a seeded generator takes its row from the seed without distance calls
+        bool seeded = m_reps.empty() && !m_seed_distances.empty();
+
+        m_rows.resize(m_rows.size() + m_cluster.size());
+        auto new_row = std::span(m_rows).last(m_cluster.size());
+        if (seeded) {
+            std::ranges::copy(m_seed_distances, new_row.begin());
+            m_seed_distances = {};
+        } else {
+            distances_to(m_dist_func, m_points[m_cluster[pos]], m_points, m_cluster, new_row);
+        }
+
+        if (m_reps.empty()) {
+            m_cur_distances.assign(new_row.begin(), new_row.end());
+        } else {
+            for (size_t i = 0; i < m_cluster.size(); i++)
+                m_cur_distances[i] = std::min(m_cur_distances[i], new_row[i]);
+        }
+
+        // The furthest member from the current reps is the next rep, its distance is the cost of the current reps
+        m_next = std::distance(m_cur_distances.begin(), std::max_element(m_cur_distances.begin(), m_cur_distances.end()));
+        m_reps.emplace_back(m_cluster[pos], m_cur_distances[m_next]);
+        m_positions.push_back(pos);
+
+        auto end = std::chrono::high_resolution_clock::now();
+
+        m_cumulative_dist_calls.push_back(dist_calls(m_reps.size() - 1) + (seeded ? 0 : m_cluster.size()));
+        m_cumulative_runtime.push_back(runtime(m_reps.size() - 1) + std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    const std::vector<T>& m_points;
+    std::span<const size_t> m_cluster;
+    const F& m_dist_func;
+
+    std::vector<std::pair<size_t, float>> m_reps;
+    std::vector<size_t> m_positions;
+    std::vector<float> m_rows;
+    std::vector<float> m_cur_distances;
+    std::vector<float> m_seed_distances;
+    size_t m_next;
+
+    std::vector<size_t> m_cumulative_dist_calls;
+    std::vector<double> m_cumulative_runtime;
+};
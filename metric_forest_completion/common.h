@@ -1,45 +1,135 @@
 #pragma once
 
+#include <cmath>
 #include <string>
 #include <tuple>
 
+#include "algo/cluster_balancing.h"
 #include "algo/k_centering.h"
+#include "algo/recursive_mfc.h"
+#include "algo/rep_allocation.h"
+#include "lib/args.h"
 #include "lib/test_runner.h"
 
+// Options that change how an evaluator builds its clustering
+struct ClusterOptions {
+    // When non-zero, clusters with more than balance_factor * N / cluster_count points are split before the forest is computed. Must be above 1
+    double balance_factor = 0;
+    // When non-zero, clusters with more than recursive_leaf_size points are solved recursively with MFC instead of an exact MST
+    size_t recursive_leaf_size = 0;
+    // When non-zero, the knn variants only compute completion edges between each cluster and the clusters of its center_neighbors nearest centers
+    size_t center_neighbors = 0;
+    // Runs the completion variants of one clustering as parallel tasks instead of one after another, results are reported in the same order
+    bool parallel_variants = false;
+
+    std::string name_prefix() const {
+        std::string res;
+        if (balance_factor != 0)
+            res += "B";
+        if (recursive_leaf_size != 0)
+            res += "R";
+        return res.empty() ? "C" : res;
+    }
+};
+
+// Command line options shared by every test that runs the standard set of evaluators
+struct StandardOptions {
+    bool cluster_test = false;
+    double balance_factor = 0;
+    int recursive_leaf_size = 0;
+    int center_neighbors = 0;
+    // Size of the thread pool shared by the test runner and the algorithms, 0 uses every hardware thread
+    int threads = 0;
+    bool parallel_variants = false;
+    // Memory budget for the tasks the test runner runs at once, such as 512M or 64G. Empty for no limit
+    std::string mem_budget;
+};
+
+inline bool parse_standard_options(int argc, char** argv, StandardOptions& options) {
+    bool parsed = parse_arg(argc, argv, "cluster_test", options.cluster_test, 'c', false) && parse_arg(argc, argv, "balance_factor", options.balance_factor, 'b', false) &&
+                  parse_arg(argc, argv, "recursive_leaf_size", options.recursive_leaf_size, 'r', false) &&
+                  parse_arg(argc, argv, "center_neighbors", options.center_neighbors, 'm', false) && parse_arg(argc, argv, "threads", options.threads, 't', false) &&
+                  parse_arg(argc, argv, "parallel_variants", options.parallel_variants, 'p', false) &&
+                  parse_arg(argc, argv, "mem_budget", options.mem_budget, {}, false);
+    if (!parsed)
+        return false;
+
+    // A factor of 1 or less would split clusters that are no larger than the average
+    if (options.balance_factor != 0 && options.balance_factor <= 1) {
+        std::print("Error: balance_factor must be greater than 1, got {}\n", options.balance_factor);
+        return false;
+    }
+
+    return true;
+}
+
 // Generates a clustering evaluator for a given amount of clusters
 template <typename Vec, typename DistFunc>
-std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_count, DistFunc orig_dist_func) {
-    return {"C" + std::to_string(cluster_count), [cluster_count, orig_dist_func](std::vector<Vec> points, size_t N) -> EvaluatorReturnType {
+std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_count, DistFunc orig_dist_func, ClusterOptions options = {}) {
+    return {options.name_prefix() + std::to_string(cluster_count), [requested_cluster_count = cluster_count, orig_dist_func, options](std::vector<Vec> points, size_t N) -> EvaluatorReturnType {
+                size_t cluster_count = requested_cluster_count;
+
                 // Code to count dist calls
-                size_t dist_calls = 0;
-                auto counting_dist_func = [&](const Vec& a, const Vec& b) {
-                    dist_calls++;
-                    return orig_dist_func(a, b);
-                };
-                auto get_dist_calls = [&]() {
-                    size_t res = dist_calls;
-                    dist_calls = 0;
-                    return res;
-                };
+                CountingDistance<DistFunc> counting_dist_func{orig_dist_func};
+                auto get_dist_calls = [&]() { return counting_dist_func.take_calls(); };
+                auto get_pruned_dist_calls = [&]() { return counting_dist_func.take_pruned(); };
+
+                // Signatures for lower bound pruning, computed once per point set
+                if constexpr (LowerBoundedDistance<DistFunc, Vec>)
+                    counting_dist_func.prepare_signatures(points);
 
                 // Run k-centering, and find the inital forest. This is shared between all code-paths below
                 auto clustering = k_centering(points, cluster_count, counting_dist_func);
+
+                // Split oversized clusters so the largest sub-forest stays bounded
+                if (options.balance_factor != 0) {
+                    size_t max_cluster_size = std::ceil(options.balance_factor * points.size() / requested_cluster_count);
+                    cluster_count = split_oversized_clusters(points, clustering, cluster_count, max_cluster_size, counting_dist_func);
+                }
+
                 size_t clustering_dist_calls = get_dist_calls();
 
-                auto cluster_vecs = create_cluster_vecs(cluster_count, points, clustering.assignments);
-                auto [cluster_msts, sub_cluster_runtime] = sub_clusters(cluster_count, points, cluster_vecs, counting_dist_func);
+                // Everything below works on points permuted into cluster order, the clustering that is reported keeps the original indices
+                auto layout = create_cluster_layout(cluster_count, points, clustering.assignments);
+                auto layout_clustering = layout.permute(clustering);
+                if constexpr (LowerBoundedDistance<DistFunc, Vec>)
+                    counting_dist_func.prepare_signatures(points);
+
+                auto cluster_vecs = create_cluster_vecs(layout);
+                std::vector<RecursionLevel> recursion_levels;
+                auto [cluster_forest, sub_cluster_runtime] = [&]() {
+                    if (options.recursive_leaf_size == 0)
+                        return sub_clusters(cluster_count, points, cluster_vecs, counting_dist_func);
+
+                    auto [forest, runtime, levels] = sub_clusters_recursive(cluster_count, points, cluster_vecs, options.recursive_leaf_size, counting_dist_func);
+                    recursion_levels = levels;
+                    return std::make_tuple(forest, runtime);
+                }();
+                cluster_forest = layout.restore(*cluster_forest);
                 size_t sub_cluster_dist_calls = get_dist_calls();
+                get_pruned_dist_calls(); // Only calls pruned by the completion are reported
+
+                // Every variant group computes its completions from the shared state above and counts its distance calls on the counter it is given. Groups only
+                // read the shared state, so they can run side by side with a counter each
+                using VariantResults = std::vector<std::pair<std::string, MetricForestCompletion>>;
+                std::vector<std::function<VariantResults(CountingDistance<DistFunc>&)>> groups;
 
-                auto f = [&](auto F) -> MetricForestCompletion {
-                    auto [unmapped_completion_edges, completion_edges_runtime] = F(cluster_count, points, cluster_vecs, counting_dist_func);
+                // Scratch is measured per completion variant, over the threads working for it
+                auto f = [&](auto F, CountingDistance<DistFunc>& dist_func) -> MetricForestCompletion {
+                    ScratchArena::Meter scratch_meter;
+                    ScratchArena::Meter::Use use_scratch_meter(&scratch_meter);
+
+                    auto [unmapped_completion_edges, completion_edges_runtime] = F(cluster_count, points, cluster_vecs, dist_func);
 
                     auto [completion, completion_runtime] = get_completion(cluster_count, unmapped_completion_edges);
                     auto completion_edges = map_completion_edges(completion);
+                    layout.restore(completion_edges);
 
-                    size_t mfc_dist_calls = get_dist_calls();
+                    size_t mfc_dist_calls = dist_func.take_calls();
+                    size_t mfc_pruned_dist_calls = dist_func.take_pruned();
 
                     MetricForestCompletion mfc{
-                        .cluster_edges = cluster_msts,
+                        .cluster_forest = cluster_forest,
                         .completion_edges = completion_edges,
                         .sub_cluster_runtime = sub_cluster_runtime,
                         .completion_edges_runtime = completion_edges_runtime,
@@ -48,67 +138,135 @@ std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_
                         .clustering_dist_calls = clustering_dist_calls,
                         .sub_cluster_dist_calls = sub_cluster_dist_calls,
                         .mfc_dist_calls = mfc_dist_calls,
+                        .mfc_pruned_dist_calls = mfc_pruned_dist_calls,
+                        .scratch_high_water = scratch_meter.peak(),
+
+                        .recursion_levels = recursion_levels,
                     };
 
                     return mfc;
                 };
+                auto single = [&](std::string name, auto F) {
+                    groups.push_back([&, name, F](CountingDistance<DistFunc>& dist_func) { return VariantResults{{name, f(F, dist_func)}}; });
+                };
 
                 // Simple is algorithm from original paper as a baseline
-                co_yield std::make_pair("simple", std::tuple{clustering, f([]<typename... Args>(Args... args) { return get_unmapped_completion_edges_approx_simple(args...); })});
+                single("simple", []<typename... Args>(Args&... args) { return get_unmapped_completion_edges_approx_simple(args...); });
                 // Plus edge checks one additional edge as a potential huristic
-                co_yield std::make_pair("plus_edge", std::tuple{clustering, f([]<typename... Args>(Args... args) { return get_unmapped_completion_edges_approx_simple_plus_edge(args...); })});
+                single("plus_edge", []<typename... Args>(Args&... args) { return get_unmapped_completion_edges_approx_simple_plus_edge(args...); });
                 // Opt optimally sovles the MFC problem
-                co_yield std::make_pair("opt", std::tuple{clustering, f([]<typename... Args>(Args... args) { return get_unmapped_completion_edges_opt(args...); })});
-
-                // Fixed reps per comp
-                for (size_t reps_per_comp = 1; reps_per_comp <= 41; reps_per_comp += 2) {
+                single("opt", []<typename... Args>(Args&... args) { return get_unmapped_completion_edges_opt(args...); });
+
+                // Knn variants only look at cluster pairs whose centers are close, the time to find those pairs is part of the completion edges runtime
+                if (options.center_neighbors != 0 && layout_clustering.centers.size() == cluster_count) {
+                    auto knn = [&](auto F) {
+                        return [&, F](size_t& count, auto& points, auto& cluster_vecs, auto& dist_func) {
+                            auto [pairs, pairs_runtime] = center_knn_pairs(points, cluster_vecs, layout_clustering.centers, options.center_neighbors, dist_func);
+                            auto [edges, runtime] = F(count, points, cluster_vecs, dist_func, pairs);
+                            return std::make_tuple(edges, runtime + pairs_runtime);
+                        };
+                    };
 
-                    float reps_cost = 0;
+                    single("knn_simple", knn([]<typename... Args>(Args&... args) { return get_unmapped_completion_edges_approx_simple(args...); }));
+                    single("knn_opt", knn([]<typename... Args>(Args&... args) { return get_unmapped_completion_edges_opt(args...); }));
+                }
 
-                    // Find 'reps_per_comp' reps for each component
-                    auto [find_reps_runtime, reps] = time_code_ret([&]() {
-                        std::vector<std::vector<std::pair<size_t, float>>> res;
-                        for (auto& v : cluster_vecs) {
-                            res.push_back(get_best_reps(cluster_count, points, v, reps_per_comp, counting_dist_func));
-                        }
-                        for (auto v : res) {
-                            reps_cost += v.back().second;
+                // Fixed reps per comp. Farthest first reps are prefix stable, so one generator per cluster is extended across the sweep and every sweep point only
+                // computes completion edges for the reps added since the previous one. Rep costs are per prefix, completion runtimes and distance calls are the totals
+                // of the sweep up to each point. These differ slightly from a completion from scratch since the bounds skip different distances, and ties between edges
+                // of equal weight can break differently, completion costs match.
+                // Generators count their calls on the shared counter and report them per prefix, so their calls are dropped from the counter of a group
+                std::vector<RepGenerator<Vec, CountingDistance<DistFunc>>> rep_generators;
+                rep_generators.reserve(cluster_count);
+                auto rep_seeds = create_rep_seeds(layout_clustering, cluster_vecs);
+                for (size_t c = 0; c < cluster_count; c++)
+                    rep_generators.emplace_back(points, cluster_vecs[c], counting_dist_func, std::move(rep_seeds[c]));
+
+                // Distance rows of the reps, used by the completion to skip members with the triangle inequality
+                auto rep_anchor = [&](size_t cluster, size_t rep) { return rep_generators[cluster].anchor(rep); };
+
+                // The sweep is incremental, so it is one group
+                groups.push_back([&](CountingDistance<DistFunc>& dist_func) {
+                    VariantResults results;
+
+                    auto rep_completion = create_rep_completion_state(cluster_vecs);
+                    double total_completion_edges_runtime = 0;
+                    size_t total_completion_dist_calls = 0;
+                    size_t total_completion_pruned_dist_calls = 0;
+
+                    for (size_t reps_per_comp = 1; reps_per_comp <= 41; reps_per_comp += 2) {
+                        ScratchArena::Meter scratch_meter;
+                        ScratchArena::Meter::Use use_scratch_meter(&scratch_meter);
+
+                        // Extend every cluster to 'reps_per_comp' reps
+                        ThreadPool::global().parallel_for(rep_generators.size(), [&](size_t i) { rep_generators[i].extend(reps_per_comp); });
+
+                        float reps_cost = 0;
+                        double find_reps_runtime = 0;
+                        size_t find_reps_dist_calls = 0;
+
+                        // Generators stop once their cluster is covered, so small clusters can have fewer reps than asked for
+                        size_t rep_count = 0;
+
+                        std::vector<std::span<const std::pair<size_t, float>>> reps;
+                        for (auto& g : rep_generators) {
+                            reps.push_back(g.reps(reps_per_comp));
+                            rep_count += reps.back().size();
+                            if (!reps.back().empty())
+                                reps_cost += reps.back().back().second;
+                            find_reps_runtime += g.runtime(reps_per_comp);
+                            find_reps_dist_calls += g.dist_calls(reps_per_comp);
                         }
-                        return res;
-                    });
+                        dist_func.take_calls(); // Already accounted for by the generators
 
-                    // Use the reps to find potential edges connecting components
-                    auto [unmapped_completion_edges, completion_edges_runtime] = get_unmapped_completion_edges_from_reps(points, cluster_vecs, reps, counting_dist_func);
+                        // Use the new reps to improve the potential edges connecting components
+                        total_completion_edges_runtime += extend_completion_edges_from_reps(rep_completion, points, cluster_vecs, reps, dist_func, rep_anchor);
+                        total_completion_dist_calls += dist_func.take_calls();
+                        total_completion_pruned_dist_calls += dist_func.take_pruned();
 
-                    // Run MST on the potential edges
-                    auto [completion, completion_runtime] = get_completion(cluster_count, unmapped_completion_edges);
-                    // Map edges back to global ids
-                    auto completion_edges = map_completion_edges(completion);
+                        double completion_edges_runtime = total_completion_edges_runtime;
+                        auto& unmapped_completion_edges = rep_completion.edges;
 
-                    size_t mfc_dist_calls = get_dist_calls();
+                        // Run MST on the potential edges
+                        auto [completion, completion_runtime] = get_completion(cluster_count, unmapped_completion_edges);
+                        // Map edges back to global ids
+                        auto completion_edges = map_completion_edges(completion);
+                        layout.restore(completion_edges);
 
-                    MetricForestCompletion mfc{
-                        .cluster_edges = cluster_msts,
-                        .completion_edges = completion_edges,
+                        size_t mfc_dist_calls = find_reps_dist_calls + total_completion_dist_calls;
+                        size_t mfc_pruned_dist_calls = total_completion_pruned_dist_calls;
 
-                        .rep_count = reps_per_comp * cluster_count,
+                        MetricForestCompletion mfc{
+                            .cluster_forest = cluster_forest,
+                            .completion_edges = completion_edges,
 
-                        .sub_cluster_runtime = sub_cluster_runtime,
-                        .completion_edges_runtime = completion_edges_runtime,
-                        .completion_runtime = completion_runtime,
-                        .find_reps_runtime = find_reps_runtime,
+                            .rep_count = rep_count,
 
-                        .reps_cost = reps_cost,
+                            .sub_cluster_runtime = sub_cluster_runtime,
+                            .completion_edges_runtime = completion_edges_runtime,
+                            .completion_runtime = completion_runtime,
+                            .find_reps_runtime = find_reps_runtime,
 
-                        .clustering_dist_calls = clustering_dist_calls,
-                        .sub_cluster_dist_calls = sub_cluster_dist_calls,
-                        .mfc_dist_calls = mfc_dist_calls,
-                    };
+                            .reps_cost = reps_cost,
 
-                    // Yeild the results back to the test runner
-                    co_yield std::make_pair("fixed_reps_" + std::to_string(reps_per_comp), std::tuple{clustering, mfc});
-                }
+                            .clustering_dist_calls = clustering_dist_calls,
+                            .sub_cluster_dist_calls = sub_cluster_dist_calls,
+                            .mfc_dist_calls = mfc_dist_calls,
+                            .mfc_pruned_dist_calls = mfc_pruned_dist_calls,
+                            .scratch_high_water = scratch_meter.peak(),
+
+                            .recursion_levels = recursion_levels,
+                        };
 
+                        results.emplace_back("fixed_reps_" + std::to_string(reps_per_comp), mfc);
+                    }
+
+                    return results;
+                });
+
+                // Rep budgets of the greedy and DP variants, the most reps any of them takes from a cluster bounds how far the generators are extended
+                std::vector<std::pair<float, size_t>> budgets;
+                size_t max_reps_per_cluster = 41;
                 for (float budget_mult = 1.0f; budget_mult <= 40.0; budget_mult += 2) {
 
                     // Must subtract cluster_count to account for the required rep per component
@@ -117,71 +275,52 @@ std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_
                     if (budget > N)
                         budget = N;
 
-                    // Find b reps per component, reused for both greedy and DP
-                    auto [find_reps_runtime, all_reps] = time_code_ret([&]() {
-                        std::vector<std::pair<size_t, std::vector<std::pair<size_t, float>>>> res;
-                        for (auto& v : cluster_vecs) {
-                            res.push_back({0, get_best_reps(cluster_count, points, v, budget + 1, counting_dist_func)}); // Plus 1 for the required one per component
-                        }
-                        return res;
-                    });
-                    size_t find_reps_dist_calls = get_dist_calls();
+                    budgets.emplace_back(budget_mult, budget);
+                    // Greedy looks one rep past its picks, which are the required rep plus at most the budget
+                    max_reps_per_cluster = std::max(max_reps_per_cluster, budget + 2);
+                }
+
+                for (auto [budget_mult, budget] : budgets) {
 
                     // Greedy
-                    {
-                        std::vector<std::vector<std::pair<size_t, float>>> final_reps;
+                    groups.push_back([&, budget_mult, budget](CountingDistance<DistFunc>& dist_func) {
+                        ScratchArena::Meter scratch_meter;
+                        ScratchArena::Meter::Use use_scratch_meter(&scratch_meter);
+
+                        std::vector<std::span<const std::pair<size_t, float>>> final_reps;
 
                         float final_cost = 0;
 
-                        // Run greedy method to pick reps
-                        auto pick_reps_runtime = time_code([&]() {
-                            // Must include first rep from each comp
-                            for (auto& c : all_reps) {
-                                final_reps.emplace_back();
-                                final_reps.back().push_back(*c.second.begin());
-                                c.first++;
-                            }
+                        // Generator work done while picking is reported as find reps time
+                        auto generated_runtime = [&]() {
+                            double res = 0;
+                            for (auto& g : rep_generators)
+                                res += g.runtime(g.size());
+                            return res;
+                        };
+                        double generated_before = generated_runtime();
 
-                            size_t reps_used = 0;
-                            while (reps_used < budget) {
-                                // Find rep that has the maximum decrease in the min distance of a component
-                                float max = -1;
-                                size_t max_cluster_index;
-                                bool found = false;
-                                for (size_t cluster_index = 0; cluster_index < cluster_count; cluster_index++) {
-                                    size_t cur_clust_ele = all_reps[cluster_index].first;
-
-                                    // Check that we still have reps to pick in this component
-                                    if (cur_clust_ele >= all_reps[cluster_index].second.size())
-                                        continue;
-
-                                    // Cost change by including another rep from this component
-                                    float diff = all_reps[cluster_index].second[cur_clust_ele - 1].second - all_reps[cluster_index].second[cur_clust_ele].second;
-
-                                    if (diff > max) {
-                                        max = diff;
-                                        max_cluster_index = cluster_index;
-                                        found = true;
-                                    }
-                                }
-
-                                // Sanity check for running out of reps
-                                if (!found) {
-                                    std::print("Ran out of reps to pick from, something went wrong reps: {}, budget: {}\n", reps_used, budget);
-                                    break;
-                                }
-
-                                final_reps[max_cluster_index].push_back(all_reps[max_cluster_index].second[all_reps[max_cluster_index].first]);
-                                all_reps[max_cluster_index].first++;
-
-                                reps_used++;
-                            }
+                        // Run greedy method to pick reps, generators are extended lazily as the heap asks for reps
+                        std::vector<size_t> counts;
+                        auto pick_reps_runtime = time_code([&]() {
+                            counts = allocate_reps_greedy(rep_generators, budget);
 
-                            // Get final_cost for calculating alpha later
-                            for (auto& v : all_reps) {
-                                final_cost += v.second[v.first - 1].second;
+                            for (size_t c = 0; c < cluster_count; c++) {
+                                final_reps.push_back(rep_generators[c].reps(counts[c]));
+                                if (!final_reps.back().empty())
+                                    final_cost += final_reps.back().back().second;
                             }
                         });
+                        pick_reps_runtime -= generated_runtime() - generated_before;
+                        dist_func.take_calls(); // Already accounted for by the generators
+
+                        // Picking needs one rep past the chosen ones to know the next cost decrease
+                        double find_reps_runtime = 0;
+                        size_t find_reps_dist_calls = 0;
+                        for (size_t c = 0; c < cluster_count; c++) {
+                            find_reps_runtime += rep_generators[c].runtime(counts[c] + 1);
+                            find_reps_dist_calls += rep_generators[c].dist_calls(counts[c] + 1);
+                        }
 
                         // Recount the number of reps picked to double check
                         size_t rep_count_double_check = 0;
@@ -189,17 +328,19 @@ std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_
                             rep_count_double_check += t.size();
 
                         // Use the reps to find potential edges connecting components
-                        auto [unmapped_completion_edges, completion_edges_runtime] = get_unmapped_completion_edges_from_reps(points, cluster_vecs, final_reps, counting_dist_func);
+                        auto [unmapped_completion_edges, completion_edges_runtime] = get_unmapped_completion_edges_from_reps(points, cluster_vecs, final_reps, dist_func, rep_anchor);
 
                         // Run MST on the potential edges
                         auto [completion, completion_runtime] = get_completion(cluster_count, unmapped_completion_edges);
                         // Map edges back to global ids
                         auto completion_edges = map_completion_edges(completion);
+                        layout.restore(completion_edges);
 
-                        size_t mfc_dist_calls = find_reps_dist_calls + get_dist_calls();
+                        size_t mfc_dist_calls = find_reps_dist_calls + dist_func.take_calls();
+                        size_t mfc_pruned_dist_calls = dist_func.take_pruned();
 
                         MetricForestCompletion mfc{
-                            .cluster_edges = cluster_msts,
+                            .cluster_forest = cluster_forest,
                             .completion_edges = completion_edges,
 
                             .rep_count = rep_count_double_check,
@@ -215,91 +356,47 @@ std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_
                             .clustering_dist_calls = clustering_dist_calls,
                             .sub_cluster_dist_calls = sub_cluster_dist_calls,
                             .mfc_dist_calls = mfc_dist_calls,
+                            .mfc_pruned_dist_calls = mfc_pruned_dist_calls,
+                            .scratch_high_water = scratch_meter.peak(),
+
+                            .recursion_levels = recursion_levels,
                         };
 
-                        // Yeild the results back to the test runner
-                        co_yield std::make_pair("greedy_" + std::to_string(budget_mult), std::tuple{clustering, mfc});
-                    }
+                        return VariantResults{{"greedy_" + std::to_string(budget_mult), mfc}};
+                    });
 
                     // DP
-                    {
-                        std::vector<std::vector<std::pair<size_t, float>>> final_reps;
+                    groups.push_back([&, budget_mult, budget](CountingDistance<DistFunc>& dist_func) {
+                        ScratchArena::Meter scratch_meter;
+                        ScratchArena::Meter::Use use_scratch_meter(&scratch_meter);
+
+                        // DP needs the full cost curve of every cluster up to the budget
+                        ThreadPool::global().parallel_for(rep_generators.size(), [&](size_t i) { rep_generators[i].extend(budget + 1); }); // Plus 1 for the required one per component
+                        dist_func.take_calls(); // Already accounted for by the generators
+
+                        double find_reps_runtime = 0;
+                        size_t find_reps_dist_calls = 0;
+                        for (auto& g : rep_generators) {
+                            find_reps_runtime += g.runtime(budget + 1);
+                            find_reps_dist_calls += g.dist_calls(budget + 1);
+                        }
 
-                        float final_cost = 0;
+                        std::vector<std::span<const std::pair<size_t, float>>> final_reps;
 
-                        // Calculate fallback final cost for b=0
-                        for (auto v : all_reps) {
-                            final_cost += v.second.begin()->second;
-                        }
+                        float final_cost = 0;
 
                         // Run DP method to pick reps
                         auto pick_reps_runtime = time_code([&]() {
-                            // Must include first rep from each comp
-                            for (auto& c : all_reps) {
-                                final_reps.emplace_back();
-                                final_reps.back().push_back(*c.second.begin());
-                            }
+                            std::vector<std::span<const std::pair<size_t, float>>> curves;
+                            for (auto& g : rep_generators)
+                                curves.push_back(g.reps(budget + 1));
 
-                            ssize_t T = cluster_count;
-                            ssize_t B = budget;
+                            auto counts = allocate_reps_dp(curves, budget);
 
-                            if (B <= 0)
-                                return;
-
-                            std::vector<float> costs;
-                            costs.resize(B + 1, 0.0f); // B + 1 includes budget of zero
-
-                            std::vector<size_t> work;
-                            work.resize((B + 1) * T, 0); // B + 1 includes budget of zero
-
-                            auto idx = [&](ssize_t b, ssize_t t) { return b + t * (B + 1); };
-
-                            for (size_t b = 0; b <= B; b++) {
-                                costs[b] = all_reps[0].second[b].second; // Get costs for first row
-                                work[idx(b, 0)] = b;
-                            }
-
-                            for (size_t t = 1; t < T; t++) {
-                                for (ssize_t b = B; b >= 0; b--) {
-                                    // Compare taking i reps from the new component and the budget b - i from the previous row
-                                    float min = INFINITY;
-                                    ssize_t min_index = 0;
-
-                                    for (ssize_t i = 0; i <= b; i++) {
-                                        float cur_cost = costs[i] + all_reps[t].second[b - i].second;
-                                        if (cur_cost < min) {
-                                            min_index = i;
-                                            min = cur_cost;
-                                        }
-                                    }
-
-                                    // Select the best option and copy the element from the previous row
-                                    costs[b] = min;
-
-                                    size_t sum = 0;
-
-                                    work[idx(b, t)] = b - min_index;
-                                    sum += b - min_index;
-
-                                    for (int j = 0; j < t; j++) {
-                                        work[idx(b, j)] = work[idx(min_index, j)];
-                                        sum += work[idx(b, j)];
-                                    }
-
-                                    // Sanity check that the sum of each entry in the matrix is b
-                                    if (sum != b) {
-                                        std::print("t: {:3}      {:6} != {:6}\n", t, sum, b);
-                                    }
-                                }
-                            }
-
-                            // Grab the final_cost and number of reps from each component from the last matrix entry
-                            final_cost = costs[B];
-
-                            for (size_t t = 0; t < T; t++) {
-                                for (size_t i = 1; i <= work[idx(B, t)]; i++) {
-                                    final_reps[t].push_back(all_reps[t].second[i]);
-                                }
+                            for (size_t t = 0; t < cluster_count; t++) {
+                                final_reps.push_back(rep_generators[t].reps(counts[t]));
+                                if (!final_reps.back().empty())
+                                    final_cost += final_reps.back().back().second;
                             }
                         });
 
@@ -309,17 +406,19 @@ std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_
                             rep_count_double_check += t.size();
 
                         // Use the reps to find potential edges connecting components
-                        auto [unmapped_completion_edges, completion_edges_runtime] = get_unmapped_completion_edges_from_reps(points, cluster_vecs, final_reps, counting_dist_func);
+                        auto [unmapped_completion_edges, completion_edges_runtime] = get_unmapped_completion_edges_from_reps(points, cluster_vecs, final_reps, dist_func, rep_anchor);
 
                         // Run MST on the potential edges
                         auto [completion, completion_runtime] = get_completion(cluster_count, unmapped_completion_edges);
                         // Map edges back to global ids
                         auto completion_edges = map_completion_edges(completion);
+                        layout.restore(completion_edges);
 
-                        size_t mfc_dist_calls = find_reps_dist_calls + get_dist_calls();
+                        size_t mfc_dist_calls = find_reps_dist_calls + dist_func.take_calls();
+                        size_t mfc_pruned_dist_calls = dist_func.take_pruned();
 
                         MetricForestCompletion mfc{
-                            .cluster_edges = cluster_msts,
+                            .cluster_forest = cluster_forest,
                             .completion_edges = completion_edges,
 
                             .rep_count = rep_count_double_check,
@@ -335,10 +434,37 @@ std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_
                             .clustering_dist_calls = clustering_dist_calls,
                             .sub_cluster_dist_calls = sub_cluster_dist_calls,
                             .mfc_dist_calls = mfc_dist_calls,
+                            .mfc_pruned_dist_calls = mfc_pruned_dist_calls,
+                            .scratch_high_water = scratch_meter.peak(),
+
+                            .recursion_levels = recursion_levels,
                         };
 
-                        // Yeild the results back to the test runner
-                        co_yield std::make_pair("dp_" + std::to_string(budget_mult), std::tuple{clustering, mfc});
+                        return VariantResults{{"dp_" + std::to_string(budget_mult), mfc}};
+                    });
+                }
+
+                if (options.parallel_variants) {
+                    // Groups run as tasks on the shared pool with a counter each, sharing the signature table of the main counter. The generators are extended as
+                    // far as any group needs up front, so groups only read them. Results are yielded in the same order as the sequential run
+                    ThreadPool::global().parallel_for(rep_generators.size(), [&](size_t i) { rep_generators[i].extend(max_reps_per_cluster); });
+                    get_dist_calls(); // Already accounted for by the generators
+
+                    std::vector<VariantResults> group_results(groups.size());
+                    ThreadPool::global().parallel_for(groups.size(), [&](size_t i) {
+                        CountingDistance<DistFunc> group_dist_func{counting_dist_func.dist_func, 0, 0, counting_dist_func.signatures};
+                        group_results[i] = groups[i](group_dist_func);
+                    });
+
+                    for (auto& results : group_results) {
+                        for (auto& [name, mfc] : results)
+                            co_yield std::make_pair(name, std::tuple{clustering, mfc});
+                    }
+                } else {
+                    // Groups run in order on the shared counter, every result is yielded as soon as it is done
+                    for (auto& group : groups) {
+                        for (auto& [name, mfc] : group(counting_dist_func))
+                            co_yield std::make_pair(name, std::tuple{clustering, mfc});
                     }
                 }
             }};
@@ -347,7 +473,7 @@ std::pair<std::string, EvaluatorType<Vec, size_t>> fixed_cluster(size_t cluster_
 // Runs the standard set of evalulators for N=30000
 template <typename Vec, typename GenFunc, typename DistFunc>
 void run_standard_evalulators(
-    std::string output_file, std::string all_output_file, bool cluster_detection_test, GenFunc&& gen_func, DistFunc&& dist_func, std::optional<size_t> N_Override = std::nullopt) {
+    std::string output_file, std::string all_output_file, StandardOptions options, GenFunc&& gen_func, DistFunc&& dist_func, std::optional<size_t> N_Override = std::nullopt) {
 
     size_t N = 30000;
     if (N_Override.has_value()) // N override is for Jaccard cooking
@@ -355,26 +481,53 @@ void run_standard_evalulators(
 
     size_t sqrtN = std::floor(std::sqrt(N));
 
+    if (options.threads > 0)
+        ThreadPool::set_global_thread_count(options.threads);
+
+    size_t memory_budget = options.mem_budget.empty() ? 0 : MUST(parse_memory_size(options.mem_budget));
+
+    ClusterOptions base{.center_neighbors = (size_t)options.center_neighbors, .parallel_variants = options.parallel_variants};
+
     // List of evaluators to run
     std::vector<std::pair<std::string, EvaluatorType<Vec, size_t>>> evaluators = {{
-        fixed_cluster<Vec>(sqrtN, dist_func),
-        fixed_cluster<Vec>(sqrtN / 2, dist_func),
-        fixed_cluster<Vec>(sqrtN / 4, dist_func),
+        fixed_cluster<Vec>(sqrtN, dist_func, base),
+        fixed_cluster<Vec>(sqrtN / 2, dist_func, base),
+        fixed_cluster<Vec>(sqrtN / 4, dist_func, base),
     }};
 
-    if (cluster_detection_test) {
+    // Balanced variants of the same cluster counts
+    if (options.balance_factor > 0) {
+        ClusterOptions balanced = base;
+        balanced.balance_factor = options.balance_factor;
+        evaluators.push_back(fixed_cluster<Vec>(sqrtN, dist_func, balanced));
+        evaluators.push_back(fixed_cluster<Vec>(sqrtN / 2, dist_func, balanced));
+        evaluators.push_back(fixed_cluster<Vec>(sqrtN / 4, dist_func, balanced));
+    }
+
+    // Recursive variants of the same cluster counts
+    if (options.recursive_leaf_size > 0) {
+        ClusterOptions recursive = base;
+        recursive.recursive_leaf_size = options.recursive_leaf_size;
+        evaluators.push_back(fixed_cluster<Vec>(sqrtN, dist_func, recursive));
+        evaluators.push_back(fixed_cluster<Vec>(sqrtN / 2, dist_func, recursive));
+        evaluators.push_back(fixed_cluster<Vec>(sqrtN / 4, dist_func, recursive));
+    }
+
+    if (options.cluster_test) {
         // Replace the set evaluators with a list of every cluster amount from 2 to 150
         evaluators.clear();
         for (int i = 2; i < 150; i++) {
-            evaluators.push_back(fixed_cluster<Vec>(i, dist_func));
+            evaluators.push_back(fixed_cluster<Vec>(i, dist_func, base));
         }
 
         // Create and run a test runner
         auto test_runner = MUST(CreateTestRunner<Vec, true, size_t>(output_file, all_output_file, std::array<std::string, 1>{"N"}, dist_func, gen_func, evaluators));
+        test_runner.set_memory_budget(memory_budget);
         MUST(test_runner.run_test(32, N));
     } else {
         // Create and run a test runner
         auto test_runner = MUST(CreateTestRunner<Vec, true, size_t>(output_file, all_output_file, std::array<std::string, 1>{"N"}, dist_func, gen_func, evaluators));
+        test_runner.set_memory_budget(memory_budget);
         MUST(test_runner.run_test(16, N));
     }
 }
\ No newline at end of file
@@ -1,24 +1,104 @@
 
 #include "lib/args.h"
+#include "lib/char_histogram.h"
 #include "lib/random_subset.h"
 
 #include "common.h"
 
 // Edit distance test
 
+// https://en.wikipedia.org/wiki/Levenshtein_distance
+// Computed with two rows of the dynamic program. dist_bounded only fills the diagonal band of cells that can stay below upper (Ukkonen) and stops once a whole
+// row is at least upper. The character histogram lower bound includes the length difference
+struct EditDistance {
+    using Signature = CharHistogram;
+
+    Signature signature(const std::string& p) const { return char_histogram(p); }
+    float lower_bound(const Signature& a, const Signature& b) const { return char_histogram_lower_bound(a, b); }
+
+    float operator()(const std::string& a, const std::string& b) const {
+        thread_local std::vector<size_t> prev, cur;
+        prev.resize(b.size() + 1);
+        cur.resize(b.size() + 1);
+
+        for (size_t j = 0; j <= b.size(); j++)
+            prev[j] = j;
+
+        for (size_t i = 1; i <= a.size(); i++) {
+            cur[0] = i;
+            for (size_t j = 1; j <= b.size(); j++) {
+                size_t substitutionCost = a[i - 1] == b[j - 1] ? 0 : 1;
+
+                cur[j] = std::min(prev[j] + 1,                               // deletion
+                                  std::min(cur[j - 1] + 1,                   // insertion
+                                           prev[j - 1] + substitutionCost)); // substitution
+            }
+            std::swap(prev, cur);
+        }
+
+        return (float)prev[b.size()];
+    }
+
+    float dist_bounded(const std::string& a, const std::string& b, float upper) const {
+        if (!(upper <= std::max(a.size(), b.size())))
+            return (*this)(a, b);
+        if (upper <= 0)
+            return INFINITY;
+
+        // Largest distance that is still below upper, every cell above it is stored as cap
+        size_t k = (size_t)std::ceil(upper) - 1;
+        size_t cap = k + 1;
+
+        size_t length_difference = a.size() > b.size() ? a.size() - b.size() : b.size() - a.size();
+        if (length_difference > k)
+            return (float)length_difference;
+
+        thread_local std::vector<size_t> prev, cur;
+        prev.assign(b.size() + 2, cap);
+        cur.assign(b.size() + 2, cap);
+
+        for (size_t j = 0; j <= std::min(b.size(), k); j++)
+            prev[j] = j;
+
+        for (size_t i = 1; i <= a.size(); i++) {
+            // Only cells with |i - j| <= k can be at most k
+            size_t lo = i > k ? i - k : 1;
+            size_t hi = std::min(b.size(), i + k);
+
+            cur[lo - 1] = lo == 1 && i <= k ? i : cap;
+            size_t row_min = cur[lo - 1];
+
+            for (size_t j = lo; j <= hi; j++) {
+                size_t substitutionCost = a[i - 1] == b[j - 1] ? 0 : 1;
+
+                cur[j] = std::min({prev[j] + 1, cur[j - 1] + 1, prev[j - 1] + substitutionCost, cap});
+                row_min = std::min(row_min, cur[j]);
+            }
+            cur[hi + 1] = cap; // Read by the next row, which reaches one cell further
+
+            if (row_min >= cap)
+                return (float)cap;
+
+            std::swap(prev, cur);
+        }
+
+        return (float)prev[b.size()];
+    }
+};
+
 int main(int argc, char** argv) {
 
     struct {
         std::string input_file;
         std::string output_file;
         std::string all_output_file;
-        bool cluster_test = false;
+        StandardOptions options;
     } args;
 
     REQUIRE(parse_arg(argc, argv, "input_file", args.input_file, 'i'), "");
     REQUIRE(parse_arg(argc, argv, "output_file", args.output_file, 'o'), "");
     REQUIRE(parse_arg(argc, argv, "all_output_file", args.all_output_file, 'a'), "");
-    REQUIRE(parse_arg(argc, argv, "cluster_test", args.cluster_test, 'c', false), "");
+    REQUIRE(parse_standard_options(argc, argv, args.options), "");
 
     // Load dataset from txt file. One string per line
     std::vector<std::string> dataset;
@@ -37,53 +117,11 @@ int main(int argc, char** argv) {
 
     std::print("Loaded dataset of size {}\n", dataset.size());
 
-    // https://en.wikipedia.org/wiki/Levenshtein_distance
-    constexpr static auto edit_dist = [](std::string a, std::string b) {
-        struct {
-            size_t* d_mem;
-            size_t row_len;
-            size_t* operator[](size_t i) { return d_mem + (i * row_len); }
-        } d;
-
-        d.d_mem = (size_t*)malloc(sizeof(size_t) * (a.size() + 1) * (b.size() + 1));
-
-        if (d.d_mem == nullptr)
-            std::print("ERROR: Could not allocate memory");
-
-        d.row_len = (b.size() + 1);
-
-        memset(d.d_mem, 0, sizeof(size_t) * (a.size() + 1) * (b.size() + 1));
-
-        for (size_t i = 1; i <= a.size(); i++)
-            d[i][0] = i;
-
-        for (size_t i = 1; i <= b.size(); i++)
-            d[0][i] = i;
-
-        for (size_t j = 1; j <= b.size(); j++)
-            for (size_t i = 1; i <= a.size(); i++) {
-                size_t substitutionCost;
-                if (a[i - 1] == b[j - 1]) {
-                    substitutionCost = 0;
-                } else {
-                    substitutionCost = 1;
-                }
-
-                d[i][j] = std::min(d[i - 1][j] + 1,                               // deletion
-                                   std::min(d[i][j - 1] + 1,                      // insertion
-                                            d[i - 1][j - 1] + substitutionCost)); // substitution
-            }
-
-        auto res = (float)d[a.size()][b.size()];
-
-        free(d.d_mem);
-
-        return res;
-    };
+    constexpr static auto edit_dist = EditDistance{};
 
     // Generate function for test runner. Returns a random size N subset from dataset
     auto gen_dataset = [&](std::default_random_engine& re, size_t N) -> ErrorOr<std::vector<std::string>> { return random_subset(dataset, N, re); };
 
     // Run standard set of evalulators
-    run_standard_evalulators<std::string>(args.output_file, args.all_output_file, args.cluster_test, gen_dataset, edit_dist);
+    run_standard_evalulators<std::string>(args.output_file, args.all_output_file, args.options, gen_dataset, edit_dist);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "lib/args.h"
+#include "lib/synthetic_data.h"
 #include "lib/test_runner.h"
 #include "lib/vec.h"
 
@@ -21,35 +22,11 @@ void test_dim() {
     using Vec = Vec<float, D>;
 
     // Euclidean distance
-    constexpr static auto dist_func = [](const Vec& a, const Vec& b) { return (b - a).length(); };
+    constexpr static auto dist_func = EuclideanDistance<Vec>{};
 
     // Generate function for test runner. Generates (num_gauss) gaussians with (points_per_gauss) points in each one
     auto gen_dataset = [&](std::default_random_engine& re, size_t num_gauss, size_t points_per_gauss) -> ErrorOr<std::vector<Vec>> {
-        std::vector<Vec> points;
-        points.reserve(num_gauss * points_per_gauss);
-
-        std::uniform_real_distribution<> random_dist(-1, 1);
-
-        constexpr auto mean_range = std::make_pair(-5.0, 5.0);
-        constexpr auto sigma_range = std::make_pair(0.5, 0.8);
-
-        for (size_t i = 0; i < num_gauss; i++) {
-            std::array<std::normal_distribution<>, D> dists;
-            for (int d = 0; d < D; d++)
-                dists[d] = std::normal_distribution{
-                    std::uniform_real_distribution{mean_range.first, mean_range.second}(re),
-                    std::uniform_real_distribution{sigma_range.first, sigma_range.second}(re),
-                };
-
-            for (size_t j = 0; j < points_per_gauss; j++) {
-                std::array<float, D> v;
-                for (int d = 0; d < D; d++)
-                    v[d] = dists[d](re);
-                points.push_back(Vec{v});
-            }
-        }
-
-        return points;
+        return gaussian_mixture<D>(Philox::from_engine(re), num_gauss, points_per_gauss);
     };
 
     // Generates a clustering evaluator for a given amount of clusters
@@ -88,11 +65,13 @@ void test_dim() {
 
         size_t N = 20000;
 
-        for (size_t gauss = 8; gauss <= 300; gauss++) {
-            size_t ppg = N / gauss;
-            std::print("Running tests for num_gauss={}, points_per_gauss={}\n", gauss, ppg);
-            MUST(test_runner.run_test(16, gauss, ppg));
-        }
+        // Every configuration runs in one pipeline, so datasets of the next configuration are generated while the current one is evaluated
+        std::vector<std::tuple<size_t, size_t>> configs;
+        for (size_t gauss = 8; gauss <= 300; gauss++)
+            configs.emplace_back(gauss, N / gauss);
+
+        std::print("Running tests for num_gauss=8..300, {} configurations\n", configs.size());
+        MUST(test_runner.run_tests(16, configs));
     }
 }
 
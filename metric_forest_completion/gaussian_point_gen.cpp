@@ -1,66 +1,64 @@
 #include "lib/error.h"
+#include "lib/synthetic_data.h"
 #include "lib/vec.h"
 
+#include <optional>
 #include <random>
 
 // Test file to generate d dimensional gaussian point data for figures
 
 template <size_t D>
-void test_dim() {
+void test_dim(const std::optional<std::string>& binary_file) {
     using Vec = Vec<float, D>;
 
-    auto gen_dataset = [&](std::default_random_engine& re, size_t num_gauss, size_t points_per_gauss) -> ErrorOr<std::vector<Vec>> {
-        std::vector<Vec> points;
-        points.reserve(num_gauss * points_per_gauss);
-
-        return points;
-    };
-
     size_t num_gauss = 30;
     size_t points_per_gauss = 300;
 
-    auto re = std::default_random_engine(std::random_device{}());
-
-    std::uniform_real_distribution<> random_dist(-1, 1);
+    auto points = gaussian_mixture<D>(Philox(((uint64_t)std::random_device{}() << 32) | std::random_device{}()), num_gauss, points_per_gauss);
 
-    constexpr auto mean_range = std::make_pair(-5.0, 5.0);
-    constexpr auto sigma_range = std::make_pair(0.5, 0.8);
+    // Binary output is the point count and dimension as uint64, the gaussian of every point as uint32, then the coordinates of every point as float32
+    if (binary_file.has_value()) {
+        static_assert(sizeof(Vec) == D * sizeof(float));
 
-    printf("g, x, y\n");
+        FILE* file = fopen(binary_file->c_str(), "wb");
+        REQUIRE(file, "Failed to open file '%s' for writing", binary_file->c_str());
 
-    for (size_t i = 0; i < num_gauss; i++) {
-        std::array<std::normal_distribution<>, D> dists;
-        for (int d = 0; d < D; d++)
-            dists[d] = std::normal_distribution{
-                std::uniform_real_distribution{mean_range.first, mean_range.second}(re),
-                std::uniform_real_distribution{sigma_range.first, sigma_range.second}(re),
-            };
+        std::array<uint64_t, 2> header = {points.size(), D};
+        std::vector<uint32_t> labels(points.size());
+        for (size_t p = 0; p < points.size(); p++)
+            labels[p] = p / points_per_gauss;
 
-        for (size_t j = 0; j < points_per_gauss; j++) {
-            printf("%lu", i);
+        fwrite(header.data(), sizeof(uint64_t), header.size(), file);
+        fwrite(labels.data(), sizeof(uint32_t), labels.size(), file);
+        fwrite(points.data(), sizeof(Vec), points.size(), file);
+        fclose(file);
+        return;
+    }
 
-            std::array<float, D> v;
-            for (int d = 0; d < D; d++) {
-                v[d] = dists[d](re);
+    printf("g, x, y\n");
 
-                printf(", %f", v[d]);
-            }
-            printf("\n");
-        }
+    for (size_t p = 0; p < points.size(); p++) {
+        printf("%lu", p / points_per_gauss);
+        for (size_t d = 0; d < D; d++)
+            printf(", %f", points[p].array[d]);
+        printf("\n");
     }
 }
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::print("Usage: {} [dim_count]\n", argv[0]);
+    if (argc != 2 && argc != 3) {
+        std::print("Usage: {} [dim_count] [binary_output_file]\n", argv[0]);
         exit(1);
     }
 
     size_t d = std::stoi(argv[1]);
+    std::optional<std::string> binary_file;
+    if (argc == 3)
+        binary_file = argv[2];
 
 #define DIM(D)                                                                                                                                                                                         \
     case D:                                                                                                                                                                                            \
-        test_dim<D>();                                                                                                                                                                                 \
+        test_dim<D>(binary_file);                                                                                                                                                                      \
         break;
 
     switch (d) {
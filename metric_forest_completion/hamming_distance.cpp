@@ -1,22 +1,66 @@
+#include <bit>
+#include <cstring>
+
 #include "lib/args.h"
+#include "lib/char_histogram.h"
 #include "lib/random_subset.h"
 
 #include "common.h"
 
 // Hamming distance test
 
+// Compares 8 characters at a time, dist_bounded stops once the count reaches upper. Lower bounds come from character histograms
+struct HammingDistance {
+    using Signature = CharHistogram;
+
+    Signature signature(const std::string& p) const { return char_histogram(p); }
+    float lower_bound(const Signature& a, const Signature& b) const { return char_histogram_lower_bound(a, b); }
+
+    float operator()(const std::string& a, const std::string& b) const { return dist_bounded(a, b, INFINITY); }
+
+    float dist_bounded(const std::string& a, const std::string& b, float upper) const {
+        REQUIRE(a.size() == b.size(), "Strings do not all have the same size\n")
+
+        size_t res = 0;
+
+        size_t i = 0;
+        for (; i + 8 <= a.size(); i += 8) {
+            uint64_t wa, wb;
+            memcpy(&wa, a.data() + i, 8);
+            memcpy(&wb, b.data() + i, 8);
+
+            // Fold every differing byte down to its lowest bit and count those bits
+            uint64_t diff = wa ^ wb;
+            diff |= diff >> 4;
+            diff |= diff >> 2;
+            diff |= diff >> 1;
+            res += std::popcount(diff & 0x0101010101010101ull);
+
+            if (res >= upper)
+                return (float)res;
+        }
+
+        for (; i < a.size(); i++) {
+            if (a[i] != b[i])
+                res++;
+        }
+
+        return (float)res;
+    }
+};
+
 int main(int argc, char** argv) {
     struct {
         std::string input_file;
         std::string output_file;
         std::string all_output_file;
-        bool cluster_test = false;
+        StandardOptions options;
     } args;
 
     REQUIRE(parse_arg(argc, argv, "input_file", args.input_file, 'i'), "");
     REQUIRE(parse_arg(argc, argv, "output_file", args.output_file, 'o'), "");
     REQUIRE(parse_arg(argc, argv, "all_output_file", args.all_output_file, 'a'), "");
-    REQUIRE(parse_arg(argc, argv, "cluster_test", args.cluster_test, 'c', false), "");
+    REQUIRE(parse_standard_options(argc, argv, args.options), "");
 
     // Load dataset from txt file. One string per line
     std::vector<std::string> dataset;
@@ -36,22 +80,11 @@ int main(int argc, char** argv) {
     std::print("Loaded dataset of size {}\n", dataset.size());
 
     // Distance function
-    constexpr static auto hamming_distance = [](std::string a, std::string b) {
-        size_t res = 0;
-
-        REQUIRE(a.size() == b.size(), "Strings do not all have the same size\n")
-
-        for (size_t i = 0; i < a.size(); i++) {
-            if (a[i] != b[i])
-                res++;
-        }
-
-        return (float)res;
-    };
+    constexpr static auto hamming_distance = HammingDistance{};
 
     // Generate function for test runner. Returns a random size N subset from dataset
     auto gen_dataset = [&](std::default_random_engine& re, size_t N) -> ErrorOr<std::vector<std::string>> { return random_subset(dataset, N, re); };
 
     // Run standard set of evalulators
-    run_standard_evalulators<std::string>(args.output_file, args.all_output_file, args.cluster_test, gen_dataset, hamming_distance);
+    run_standard_evalulators<std::string>(args.output_file, args.all_output_file, args.options, gen_dataset, hamming_distance);
 }
\ No newline at end of file
@@ -14,13 +14,13 @@ int main(int argc, char** argv) {
         std::string input_file;
         std::string output_file;
         std::string all_output_file;
-        bool cluster_test = false;
+        StandardOptions options;
     } args;
 
     REQUIRE(parse_arg(argc, argv, "input_file", args.input_file, 'i'), "");
     REQUIRE(parse_arg(argc, argv, "output_file", args.output_file, 'o'), "");
     REQUIRE(parse_arg(argc, argv, "all_output_file", args.all_output_file, 'a'), "");
-    REQUIRE(parse_arg(argc, argv, "cluster_test", args.cluster_test, 'c', false), "");
+    REQUIRE(parse_standard_options(argc, argv, args.options), "");
 
     // Vector type to be used
     using Vec = Vec<float, 784>;
@@ -29,11 +29,11 @@ int main(int argc, char** argv) {
     auto dataset = MUST(HDF5::load_data_set<Vec>(args.input_file, "train"));
 
     // Euclidean distance
-    static constexpr auto dist_func = [](const Vec& a, const Vec& b) { return (b - a).length(); };
+    static constexpr auto dist_func = EuclideanDistance<Vec>{};
 
     // Generate function for test runner. Returns a random size N subset from dataset
     auto gen_dataset = [&](std::default_random_engine& re, size_t N) -> ErrorOr<std::vector<Vec>> { return random_subset(dataset, N, re); };
 
     // Run standard set of evalulators
-    run_standard_evalulators<Vec>(args.output_file, args.all_output_file, args.cluster_test, gen_dataset, dist_func);
+    run_standard_evalulators<Vec>(args.output_file, args.all_output_file, args.options, gen_dataset, dist_func);
 }
\ No newline at end of file
@@ -8,20 +8,62 @@
 
 // Jaccard similarity distance test
 
+// Counts the intersection with a single merge over both sets, the union size follows from it. dist_bounded first checks the size ratio bound
+// 1 - min(|A|, |B|) / max(|A|, |B|), which is at most the distance
+struct JaccardDistance {
+    // The set size is enough for the size ratio bound
+    using Signature = size_t;
+
+    Signature signature(const std::set<size_t>& p) const { return p.size(); }
+    float lower_bound(const Signature& a, const Signature& b) const {
+        auto [min_size, max_size] = std::minmax(a, b);
+        return max_size == 0 ? 0.0f : 1.0f - (float)min_size / max_size;
+    }
+
+    float operator()(const std::set<size_t>& a, const std::set<size_t>& b) const {
+        size_t intersection = 0;
+        for (auto it_a = a.begin(), it_b = b.begin(); it_a != a.end() && it_b != b.end();) {
+            if (*it_a < *it_b) {
+                it_a++;
+            } else if (*it_b < *it_a) {
+                it_b++;
+            } else {
+                intersection++;
+                it_a++;
+                it_b++;
+            }
+        }
+
+        size_t union_size = a.size() + b.size() - intersection;
+        if (union_size == 0) {
+            return 1.0;
+        }
+
+        return 1.0f - (float)intersection / union_size;
+    }
+
+    float dist_bounded(const std::set<size_t>& a, const std::set<size_t>& b, float upper) const {
+        if (float bound = lower_bound(a.size(), b.size()); bound >= upper)
+            return bound;
+
+        return (*this)(a, b);
+    }
+};
+
 int main(int argc, char** argv) {
 
     struct {
         std::string input_file;
         std::string output_file;
         std::string all_output_file;
-        bool cluster_test = false;
+        StandardOptions options;
         int edge_size_filter;
     } args;
 
     REQUIRE(parse_arg(argc, argv, "input_file", args.input_file, 'i'), "");
     REQUIRE(parse_arg(argc, argv, "output_file", args.output_file, 'o'), "");
     REQUIRE(parse_arg(argc, argv, "all_output_file", args.all_output_file, 'a'), "");
-    REQUIRE(parse_arg(argc, argv, "cluster_test", args.cluster_test, 'c', false), "");
+    REQUIRE(parse_standard_options(argc, argv, args.options), "");
     REQUIRE(parse_arg(argc, argv, "edge_size_filter", args.edge_size_filter, 'e'), "");
 
     // Load dataset from txt file. One set per line of comma seperated integers
@@ -50,23 +92,11 @@ int main(int argc, char** argv) {
     std::print("Loaded dataset of size {}\n", dataset.size());
 
     // Jaccard similarity distance
-    constexpr static auto jaccard = [](std::set<size_t> a, std::set<size_t> b) -> float {
-        std::set<size_t> intersection;
-        set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::inserter(intersection, intersection.begin()));
-
-        std::set<size_t> union_set;
-        set_union(a.begin(), a.end(), b.begin(), b.end(), std::inserter(union_set, union_set.begin()));
-
-        if (union_set.empty()) {
-            return 1.0;
-        }
-
-        return 1.0f - (float)intersection.size() / union_set.size();
-    };
+    constexpr static auto jaccard = JaccardDistance{};
 
     // Generate function for test runner. Returns a random size N subset from dataset
     auto gen_dataset = [&](std::default_random_engine& re, size_t N) -> ErrorOr<std::vector<std::set<size_t>>> { return random_subset(dataset, N, re); };
 
     // Run standard set of evalulators
-    run_standard_evalulators<std::set<size_t>>(args.output_file, args.all_output_file, args.cluster_test, gen_dataset, jaccard, dataset.size());
+    run_standard_evalulators<std::set<size_t>>(args.output_file, args.all_output_file, args.options, gen_dataset, jaccard, dataset.size());
 }
\ No newline at end of file
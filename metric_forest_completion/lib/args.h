@@ -21,7 +21,7 @@ bool parse_arg(int argc, char** argv, std::string name, T& t, std::optional<char
         if ((strcmp(argv[i], arg_name.c_str()) == 0) || (arg_short_name.has_value() && strcmp(argv[i], arg_short_name->c_str()) == 0)) {
             found_arg = true;
 
-            static_assert(std::is_same_v<T, std::string> || std::is_same_v<T, bool> || std::is_same_v<T, int>);
+            static_assert(std::is_same_v<T, std::string> || std::is_same_v<T, bool> || std::is_same_v<T, int> || std::is_same_v<T, double>);
 
             if constexpr (std::is_same_v<T, std::string>) {
                 t = argv[i + 1];
@@ -38,7 +38,7 @@ bool parse_arg(int argc, char** argv, std::string name, T& t, std::optional<char
                     return false;
             }
 
-            if constexpr (std::is_same_v<T, int>) {
+            if constexpr (std::is_same_v<T, int> || std::is_same_v<T, double>) {
                 t = std::stod(argv[i + 1]);
             }
         }
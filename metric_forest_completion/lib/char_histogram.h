@@ -0,0 +1,33 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Character count signature for string metrics. Characters are hashed into a few buckets, surplus and deficit sum the positive and negative bucket count
+// differences between two strings. Every edit operation and every hamming mismatch lowers at most one of them by one, so max(surplus, deficit) is a lower bound
+// for both distances. It is never below the length difference
+
+struct CharHistogram {
+    std::array<uint32_t, 16> counts{};
+};
+
+inline CharHistogram char_histogram(const std::string& s) {
+    CharHistogram res;
+    for (unsigned char c : s)
+        res.counts[c % res.counts.size()]++;
+    return res;
+}
+
+inline float char_histogram_lower_bound(const CharHistogram& a, const CharHistogram& b) {
+    uint32_t surplus = 0;
+    uint32_t deficit = 0;
+    for (size_t i = 0; i < a.counts.size(); i++) {
+        if (a.counts[i] > b.counts[i])
+            surplus += a.counts[i] - b.counts[i];
+        else
+            deficit += b.counts[i] - a.counts[i];
+    }
+    return (float)std::max(surplus, deficit);
+}
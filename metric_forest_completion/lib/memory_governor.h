@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "error.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// Parses a byte count with an optional K, M, G or T suffix (powers of 1024), such as 512M or 64G
+inline ErrorOr<size_t> parse_memory_size(const std::string& str) {
+    double value = 0;
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec != std::errc())
+        return ERR("Invalid memory size '" + str + "'");
+    size_t end = ptr - str.data();
+
+    double scale = 1;
+    if (end < str.size()) {
+        switch (std::toupper((unsigned char)str[end])) {
+        case 'K': scale = 1ull << 10; break;
+        case 'M': scale = 1ull << 20; break;
+        case 'G': scale = 1ull << 30; break;
+        case 'T': scale = 1ull << 40; break;
+        default: return ERR("Invalid memory size suffix in '" + str + "'");
+        }
+        end++;
+        if (end < str.size() && std::toupper((unsigned char)str[end]) == 'B')
+            end++;
+    }
+
+    if (end != str.size() || value < 0)
+        return ERR("Invalid memory size '" + str + "'");
+
+    return (size_t)(value * scale);
+}
+
+// Resident set size of the process in bytes, 0 where it can not be measured
+inline size_t resident_memory() {
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    size_t pages = 0;
+    size_t resident = 0;
+    int read = fscanf(file, "%zu %zu", &pages, &resident);
+    fclose(file);
+    return read == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+// Admission control for tasks with an estimated memory footprint. A task is admitted once its charge fits in the budget next to the charges already taken, a task
+// is always admitted when no other task is running so oversized tasks still make progress. Memory that outlives a task, such as a dataset shared by several tasks,
+// is held without waiting and only counts against the budget. Task charges are the estimates scaled by a correction factor that follows the measured resident
+// memory, so estimates that are consistently off are corrected over the run. A budget of 0 admits everything
+class MemoryGovernor {
+  public:
+    explicit MemoryGovernor(size_t budget) : m_budget(budget), m_baseline(resident_memory()) {}
+
+    // Blocks until the task fits. Returns the charge that has to be passed to release
+    size_t admit(size_t estimate) {
+        std::unique_lock lock(m_mutex);
+        size_t charge = estimate * m_correction;
+        m_cv.wait(lock, [&]() { return m_budget == 0 || m_running == 0 || (!m_alone && m_in_use + charge <= m_budget); });
+        m_in_use += charge;
+        m_running++;
+        return charge;
+    }
+
+    // Blocks until no other task is running, for a task whose footprint is only known once it ran. No other task is admitted until release_alone
+    void admit_alone() {
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock, [&]() { return m_budget == 0 || m_running == 0; });
+        m_running++;
+        m_alone = true;
+    }
+
+    void release_alone() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_running--;
+            m_alone = false;
+        }
+        m_cv.notify_all();
+    }
+
+    // Whether a task would be admitted right now without waiting for the tasks that are running. An estimate of 0 stands for an unknown size and never fits
+    bool fits(size_t estimate) {
+        std::lock_guard lock(m_mutex);
+        return estimate != 0 && (m_budget == 0 || (!m_alone && m_in_use + (size_t)(estimate * m_correction) <= m_budget));
+    }
+
+    // Counts bytes against the budget until release_held, without waiting
+    void hold(size_t bytes) {
+        std::lock_guard lock(m_mutex);
+        m_in_use += bytes;
+    }
+
+    void release_held(size_t bytes) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_in_use -= std::min(bytes, m_in_use);
+        }
+        m_cv.notify_all();
+    }
+
+    void release(size_t charge) {
+        size_t resident = resident_memory();
+        {
+            std::lock_guard lock(m_mutex);
+
+            // Memory the admitted tasks actually hold compared to what they were charged. Allocators keep some freed memory, so this errs on the safe side
+            if (resident > m_baseline && m_in_use > 0) {
+                double ratio = (double)(resident - m_baseline) / m_in_use;
+                m_correction = std::clamp(0.75 * m_correction + 0.25 * ratio, 0.5, 4.0);
+            }
+
+            m_in_use -= std::min(charge, m_in_use);
+            m_running--;
+        }
+        m_cv.notify_all();
+    }
+
+  private:
+    size_t m_budget;
+    size_t m_baseline;
+    size_t m_in_use = 0;
+    size_t m_running = 0;
+    bool m_alone = false;
+    double m_correction = 1;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <span>
+
+// Philox4x32-10 counter based random numbers. Every value is a pure function of the key, a stream id and its index in the stream, so any range of a stream can be
+// generated on its own and datasets come out the same no matter how their generation is split between threads. A block of 4 values is computed per counter
+
+class Philox {
+  public:
+    explicit Philox(uint64_t key) : m_key{(uint32_t)key, (uint32_t)(key >> 32)} {}
+
+    // Key drawn from a standard engine, so the datasets follow the seed of a test runner
+    template <typename Engine>
+    static Philox from_engine(Engine& engine) {
+        uint64_t key = 0;
+        for (int i = 0; i < 4; i++)
+            key = (key << 16) ^ (uint64_t)engine();
+        return Philox(key);
+    }
+
+    std::array<uint32_t, 4> block(uint64_t stream, uint64_t counter) const {
+        std::array<uint32_t, 4> ctr = {(uint32_t)counter, (uint32_t)(counter >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+        std::array<uint32_t, 2> key = m_key;
+
+        for (int round = 0; round < 10; round++) {
+            if (round != 0) {
+                key[0] += 0x9E3779B9;
+                key[1] += 0xBB67AE85;
+            }
+
+            uint64_t p0 = (uint64_t)0xD2511F53 * ctr[0];
+            uint64_t p1 = (uint64_t)0xCD9E8D57 * ctr[2];
+            ctr = {(uint32_t)(p1 >> 32) ^ ctr[1] ^ key[0], (uint32_t)p1, (uint32_t)(p0 >> 32) ^ ctr[3] ^ key[1], (uint32_t)p0};
+        }
+
+        return ctr;
+    }
+
+    // out[i] is uniform in [lo, hi), the value at index first + i of the stream
+    void uniform(uint64_t stream, uint64_t first, std::span<float> out, float lo = 0, float hi = 1) const {
+        fill(stream, first, out, [&](const std::array<uint32_t, 4>& words) {
+            std::array<float, 4> values;
+            for (size_t word = 0; word < 4; word++)
+                values[word] = lo + (hi - lo) * to_unit(words[word]);
+            return values;
+        });
+    }
+
+    // out[i] is normal with the given mean and sigma, the value at index first + i of the stream. Each block gives two Box-Muller pairs
+    void normal(uint64_t stream, uint64_t first, std::span<float> out, float mean = 0, float sigma = 1) const {
+        fill(stream, first, out, [&](const std::array<uint32_t, 4>& words) {
+            std::array<float, 4> values;
+            for (size_t pair = 0; pair < 4; pair += 2) {
+                float radius = sigma * std::sqrt(-2.0f * std::log(1.0f - to_unit(words[pair])));
+                float angle = 2.0f * std::numbers::pi_v<float> * to_unit(words[pair + 1]);
+                values[pair] = mean + radius * std::cos(angle);
+                values[pair + 1] = mean + radius * std::sin(angle);
+            }
+            return values;
+        });
+    }
+
+  private:
+    // Top 24 bits as a float in [0, 1)
+    static float to_unit(uint32_t word) { return (word >> 8) * (1.0f / 16777216.0f); }
+
+    // Fills out with the values at index first onwards, every block is computed once and turned into 4 values by f
+    template <typename F>
+    void fill(uint64_t stream, uint64_t first, std::span<float> out, F&& f) const {
+        size_t i = 0;
+        while (i < out.size()) {
+            uint64_t index = first + i;
+            auto values = f(block(stream, index / 4));
+            for (size_t word = index % 4; word < 4 && i < out.size(); word++, i++)
+                out[i] = values[word];
+        }
+    }
+
+    std::array<uint32_t, 2> m_key;
+};
@@ -0,0 +1,432 @@
+#pragma once
+
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "error.h"
+#include "fileio.h"
+
+// Tables of test results, written either as CSV or, for files ending in .mfcr, in a binary columnar format. Both are written through a background thread with
+// large buffers, so the test runner only pays for formatting into memory.
+//
+// The binary format is native endian. It starts with the magic "MFCR" and a uint32 version, followed by row groups. A row group stores every column in turn:
+// Double columns as float64, UInt columns as uint64 and Key columns as uint32 indices into the dictionary. The footer holds the schema (uint32 column count, then
+// per column a uint8 type, uint32 name length and the name), the dictionary (uint32 entry count, then per entry a uint32 length and the string) and the row groups
+// (uint32 count, then per group a uint64 file offset and uint64 row count). The file ends with the uint64 offset of the footer and the magic again
+
+// Writes to a file on a background thread. Data is gathered in buffers of buffer_size bytes, writers block once max_queued buffers are waiting
+class AsyncFileWriter {
+  public:
+    static constexpr size_t buffer_size = 4 << 20;
+    static constexpr size_t max_queued = 4;
+
+    static ErrorOr<std::unique_ptr<AsyncFileWriter>> open(const std::string& path) {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            return ERR("Failed to open file '" + path + "' for writing");
+        return std::unique_ptr<AsyncFileWriter>(new AsyncFileWriter(file));
+    }
+
+    ~AsyncFileWriter() { MAYBE(close()); }
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    void write(std::string_view bytes) {
+        m_buffer.append(bytes);
+        m_offset += bytes.size();
+        if (m_buffer.size() >= buffer_size)
+            flush();
+    }
+
+    // Hands the current buffer to the writer thread
+    void flush() {
+        if (m_buffer.empty())
+            return;
+
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock, [&]() { return m_queue.size() < max_queued; });
+        m_queue.push_back(std::move(m_buffer));
+        m_buffer = {};
+        m_buffer.reserve(buffer_size);
+        m_cv.notify_all();
+    }
+
+    // Bytes written so far, including the ones still buffered
+    size_t offset() const { return m_offset; }
+
+    ErrorOr<void> close() {
+        if (!m_file)
+            return {};
+
+        flush();
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+
+        bool failed = m_failed || fclose(m_file) != 0;
+        m_file = nullptr;
+        if (failed)
+            return ERR("Failed to write results file");
+        return {};
+    }
+
+  private:
+    explicit AsyncFileWriter(FILE* file) : m_file(file) {
+        m_buffer.reserve(buffer_size);
+        m_thread = std::thread([this]() { write_loop(); });
+    }
+
+    void write_loop() {
+        while (true) {
+            std::string buffer;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [&]() { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty())
+                    return;
+                buffer = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            m_cv.notify_all();
+
+            if (fwrite(buffer.data(), 1, buffer.size(), m_file) != buffer.size())
+                m_failed = true;
+        }
+    }
+
+    FILE* m_file;
+    std::string m_buffer;
+    size_t m_offset = 0;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::string> m_queue;
+    bool m_stop = false;
+    bool m_failed = false;
+};
+
+enum class ColumnType : uint8_t { Double, UInt, Key };
+
+struct ResultColumn {
+    std::string name;
+    ColumnType type;
+};
+
+// Cells are formatted the same way by the CSV writer and the converter, shortest round trip for doubles
+inline void append_csv_cell(std::string& out, double v) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, res.ptr);
+}
+
+inline void append_csv_cell(std::string& out, uint64_t v) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, res.ptr);
+}
+
+constexpr char result_table_magic[4] = {'M', 'F', 'C', 'R'};
+constexpr uint32_t result_table_version = 1;
+
+class ResultTable {
+  public:
+    // Rows of a binary table are buffered per column and written in groups of row_group_size, or when flushed
+    static constexpr size_t row_group_size = 256;
+
+    static ErrorOr<ResultTable> create(const std::string& path, std::vector<ResultColumn> columns) {
+        ResultTable table;
+        table.m_writer = TRY(AsyncFileWriter::open(path));
+        table.m_columns = std::move(columns);
+        table.m_binary = path.ends_with(".mfcr");
+
+        if (table.m_binary) {
+            table.m_writer->write(std::string_view(result_table_magic, 4));
+            table.write_raw(result_table_version);
+            table.m_data.resize(table.m_columns.size());
+        } else {
+            for (auto& column : table.m_columns)
+                table.begin_cell().append(column.name);
+            table.end_row();
+        }
+
+        return table;
+    }
+
+    ResultTable() = default;
+    ResultTable(ResultTable&&) = default;
+    ResultTable& operator=(ResultTable&&) = default;
+
+    ~ResultTable() { MAYBE(close()); }
+
+    // Adds the next cell of the current row. Numbers go to Double or UInt columns, strings to Key columns
+    template <typename T>
+    void add(const T& v) {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (m_binary)
+                push(ColumnType::Double, (double)v);
+            else
+                append_csv_cell(begin_cell(), (double)v);
+        } else if constexpr (std::is_integral_v<T>) {
+            if (m_binary)
+                push(ColumnType::UInt, (uint64_t)v);
+            else
+                append_csv_cell(begin_cell(), (uint64_t)v);
+        } else {
+            if (m_binary)
+                push(ColumnType::Key, key_index(v));
+            else
+                begin_cell().append(std::string_view(v));
+        }
+    }
+
+    void end_row() {
+        REQUIRE(m_cell == m_columns.size(), "Row has %zu cells for %zu columns", m_cell, m_columns.size());
+        m_cell = 0;
+
+        if (m_binary) {
+            if (++m_group_rows == row_group_size)
+                write_group();
+        } else {
+            m_row.push_back('\n');
+            m_writer->write(m_row);
+            m_row.clear();
+        }
+    }
+
+    // Passes every finished row on to the writer thread
+    void flush() {
+        if (m_binary)
+            write_group();
+        m_writer->flush();
+    }
+
+    ErrorOr<void> close() {
+        if (!m_writer)
+            return {};
+
+        if (m_binary) {
+            write_group();
+            write_footer();
+        }
+
+        auto writer = std::move(m_writer);
+        return writer->close();
+    }
+
+  private:
+    // Raw bytes of the cells of one column in the current row group
+    using ColumnData = std::string;
+
+    template <typename T>
+    static void append_raw(std::string& out, const T& v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    template <typename T>
+    void write_raw(const T& v) {
+        m_writer->write(std::string_view(reinterpret_cast<const char*>(&v), sizeof(T)));
+    }
+
+    std::string& begin_cell() {
+        if (m_cell++ != 0)
+            m_row.append(", ");
+        return m_row;
+    }
+
+    template <typename T>
+    void push(ColumnType type, T v) {
+        REQUIRE(m_cell < m_columns.size() && m_columns[m_cell].type == type, "Cell %zu does not match the type of its column", m_cell);
+        append_raw(m_data[m_cell++], v);
+    }
+
+    uint32_t key_index(std::string_view key) {
+        auto it = m_key_indices.find(std::string(key));
+        if (it != m_key_indices.end())
+            return it->second;
+
+        uint32_t index = m_keys.size();
+        m_keys.emplace_back(key);
+        m_key_indices.emplace(m_keys.back(), index);
+        return index;
+    }
+
+    void write_group() {
+        if (m_group_rows == 0)
+            return;
+
+        m_groups.emplace_back(m_writer->offset(), m_group_rows);
+        for (auto& data : m_data) {
+            m_writer->write(data);
+            data.clear();
+        }
+        m_group_rows = 0;
+    }
+
+    void write_footer() {
+        std::string footer;
+        append_raw(footer, (uint32_t)m_columns.size());
+        for (auto& column : m_columns) {
+            append_raw(footer, column.type);
+            append_raw(footer, (uint32_t)column.name.size());
+            footer.append(column.name);
+        }
+
+        append_raw(footer, (uint32_t)m_keys.size());
+        for (auto& key : m_keys) {
+            append_raw(footer, (uint32_t)key.size());
+            footer.append(key);
+        }
+
+        append_raw(footer, (uint32_t)m_groups.size());
+        for (auto [offset, rows] : m_groups) {
+            append_raw(footer, (uint64_t)offset);
+            append_raw(footer, (uint64_t)rows);
+        }
+
+        uint64_t footer_offset = m_writer->offset();
+        m_writer->write(footer);
+        write_raw(footer_offset);
+        m_writer->write(std::string_view(result_table_magic, 4));
+    }
+
+    std::unique_ptr<AsyncFileWriter> m_writer;
+    std::vector<ResultColumn> m_columns;
+    bool m_binary = false;
+    size_t m_cell = 0;
+
+    // CSV row being formatted
+    std::string m_row;
+
+    // Binary row group being gathered
+    std::vector<ColumnData> m_data;
+    size_t m_group_rows = 0;
+    std::vector<std::pair<size_t, size_t>> m_groups;
+    std::vector<std::string> m_keys;
+    std::unordered_map<std::string, uint32_t> m_key_indices;
+};
+
+// Bounds checked reads from a loaded results file
+struct ResultFileReader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+
+    template <typename T>
+    ErrorOr<T> read() {
+        if (pos + sizeof(T) > size)
+            return ERR("Results file is truncated");
+        T v;
+        memcpy(&v, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+
+    ErrorOr<std::string> read_string() {
+        uint32_t length = TRY(read<uint32_t>());
+        if (pos + length > size)
+            return ERR("Results file is truncated");
+        std::string str(reinterpret_cast<const char*>(data + pos), length);
+        pos += length;
+        return str;
+    }
+};
+
+// Converts a binary results file to the CSV a ResultTable writes for other file names
+inline ErrorOr<void> results_to_csv(const std::string& in_file, const std::string& out_file) {
+    auto file = TRY(load_file(in_file));
+    const uint8_t* data = file.buffer.get();
+    size_t size = file.size;
+
+    if (size < 24 || memcmp(data, result_table_magic, 4) != 0 || memcmp(data + size - 4, result_table_magic, 4) != 0)
+        return ERR("'" + in_file + "' is not a results file");
+
+    ResultFileReader header{data, size, 4};
+    uint32_t version = TRY(header.read<uint32_t>());
+    if (version != result_table_version)
+        return ERR("Unsupported results file version " + std::to_string(version));
+
+    ResultFileReader footer{data, size - 4, size - 12};
+    footer.pos = TRY(footer.read<uint64_t>());
+
+    std::vector<ResultColumn> columns(TRY(footer.read<uint32_t>()));
+    for (auto& column : columns) {
+        column.type = TRY(footer.read<ColumnType>());
+        column.name = TRY(footer.read_string());
+    }
+
+    std::vector<std::string> keys(TRY(footer.read<uint32_t>()));
+    for (auto& key : keys)
+        key = TRY(footer.read_string());
+
+    std::vector<std::pair<uint64_t, uint64_t>> groups(TRY(footer.read<uint32_t>()));
+    for (auto& [offset, rows] : groups) {
+        offset = TRY(footer.read<uint64_t>());
+        rows = TRY(footer.read<uint64_t>());
+    }
+
+    auto out = TRY(AsyncFileWriter::open(out_file));
+
+    std::string row;
+    for (size_t c = 0; c < columns.size(); c++) {
+        if (c != 0)
+            row.append(", ");
+        row.append(columns[c].name);
+    }
+    row.push_back('\n');
+    out->write(row);
+
+    for (auto [offset, rows] : groups) {
+        // Every column of a group holds 8 bytes per row except key columns, which hold 4
+        std::vector<size_t> column_offsets(columns.size());
+        size_t pos = offset;
+        for (size_t c = 0; c < columns.size(); c++) {
+            column_offsets[c] = pos;
+            pos += rows * (columns[c].type == ColumnType::Key ? 4 : 8);
+        }
+        if (pos > size)
+            return ERR("Results file is truncated");
+
+        for (size_t r = 0; r < rows; r++) {
+            row.clear();
+            for (size_t c = 0; c < columns.size(); c++) {
+                if (c != 0)
+                    row.append(", ");
+
+                ResultFileReader cell{data, pos, column_offsets[c]};
+                switch (columns[c].type) {
+                case ColumnType::Double: append_csv_cell(row, TRY(cell.read<double>())); break;
+                case ColumnType::UInt: append_csv_cell(row, TRY(cell.read<uint64_t>())); break;
+                case ColumnType::Key: {
+                    uint32_t key = TRY(cell.read<uint32_t>());
+                    if (key >= keys.size())
+                        return ERR("Invalid key in results file");
+                    row.append(keys[key]);
+                    break;
+                }
+                }
+                column_offsets[c] = cell.pos;
+            }
+            row.push_back('\n');
+            out->write(row);
+        }
+    }
+
+    TRY(out->close());
+    return {};
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Per thread monotonic arena for short lived buffers. Memory is carved from blocks that stay allocated between uses, so scratch space stops going through the
+// global allocator once a thread has warmed up. A Scope hands back everything taken while it was alive, scopes on one thread must end in reverse order.
+// Blocks above retain_limit are freed when they are handed back so one large request does not pin memory for the lifetime of the thread
+
+class ScratchArena {
+  public:
+    class Scope {
+      public:
+        Scope() : m_arena(local()), m_block(m_arena.m_block), m_offset(m_arena.m_offset), m_used(m_arena.m_used) {}
+        ~Scope() { m_arena.release(m_block, m_offset, m_used); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        // count default initialized values, valid until the scope ends
+        template <typename T>
+        std::span<T> take(size_t count) {
+            static_assert(std::is_trivially_destructible_v<T>, "Scratch values are never destroyed");
+            auto ptr = static_cast<T*>(m_arena.allocate(count * sizeof(T), alignof(T)));
+            std::uninitialized_default_construct_n(ptr, count);
+            return {ptr, count};
+        }
+
+      private:
+        ScratchArena& m_arena;
+        size_t m_block;
+        size_t m_offset;
+        size_t m_used;
+    };
+
+    // Largest amount of bytes any one thread held at once while working for the meter. A thread works for a meter while a Use of it is alive, scratch taken
+    // before the Use began is not counted. The thread pool carries the meter of the submitting thread into its tasks, so work that runs side by side for other
+    // meters, such as other evaluators, is kept apart
+    class Meter {
+      public:
+        size_t peak() const { return m_peak.load(std::memory_order_relaxed); }
+
+        class Use {
+          public:
+            // Using the meter the thread already works for keeps counting from where it began, so tasks run while waiting add to the scratch of the waiter
+            explicit Use(Meter* meter) : m_arena(local()), m_meter(m_arena.m_meter), m_base(m_arena.m_meter_base) {
+                if (meter != m_meter)
+                    m_arena.m_meter_base = m_arena.m_used;
+                m_arena.m_meter = meter;
+            }
+            ~Use() {
+                m_arena.m_meter = m_meter;
+                m_arena.m_meter_base = m_base;
+            }
+
+            Use(const Use&) = delete;
+            Use& operator=(const Use&) = delete;
+
+          private:
+            ScratchArena& m_arena;
+            Meter* m_meter;
+            size_t m_base;
+        };
+
+      private:
+        friend class ScratchArena;
+
+        void record(size_t used) {
+            size_t cur = m_peak.load(std::memory_order_relaxed);
+            while (used > cur && !m_peak.compare_exchange_weak(cur, used, std::memory_order_relaxed)) {
+            }
+        }
+
+        std::atomic<size_t> m_peak = 0;
+    };
+
+    static ScratchArena& local() {
+        thread_local ScratchArena arena;
+        return arena;
+    }
+
+    // Meter this thread is working for, nullptr when none
+    static Meter* current_meter() { return local().m_meter; }
+
+  private:
+    static constexpr size_t block_size = 1 << 20;
+    static constexpr size_t retain_limit = 16 << 20;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    void* allocate(size_t bytes, size_t alignment) {
+        while (true) {
+            if (m_block < m_blocks.size()) {
+                auto& block = m_blocks[m_block];
+                size_t offset = (m_offset + alignment - 1) / alignment * alignment;
+                if (offset + bytes <= block.size) {
+                    m_used += offset + bytes - m_offset;
+                    m_offset = offset + bytes;
+                    if (m_meter)
+                        m_meter->record(m_used - m_meter_base);
+                    return block.data.get() + offset;
+                }
+
+                // Skip to the next block, the rest of this one stays unused until the scope ends
+                m_used += block.size - m_offset;
+                m_block++;
+                m_offset = 0;
+                continue;
+            }
+
+            size_t size = std::max(block_size, bytes + alignment);
+            m_blocks.push_back({std::make_unique_for_overwrite<std::byte[]>(size), size});
+        }
+    }
+
+    void release(size_t block, size_t offset, size_t used) {
+        // Only blocks that are now entirely unused can be freed, the block being returned to is unused when the scope began at its start
+        size_t first_unused = offset == 0 ? block : block + 1;
+        for (size_t i = m_blocks.size(); i-- > first_unused;) {
+            if (m_blocks[i].size > retain_limit)
+                m_blocks.erase(m_blocks.begin() + i);
+        }
+        m_block = block;
+        m_offset = offset;
+        m_used = used;
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_block = 0;
+    size_t m_offset = 0;
+    size_t m_used = 0;
+
+    Meter* m_meter = nullptr;
+    size_t m_meter_base = 0;
+};
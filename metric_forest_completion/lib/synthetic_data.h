@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "philox.h"
+#include "thread_pool.h"
+#include "vec.h"
+
+// Synthetic datasets. Points are generated in parallel over ranges, every coordinate comes from its own index of the random streams so the result only depends on
+// the key
+
+// N points uniform in [-1, 1) in every dimension
+template <size_t D>
+std::vector<Vec<float, D>> uniform_points(const Philox& rng, size_t N) {
+    std::vector<Vec<float, D>> points(N);
+
+    constexpr size_t chunk_size = 1024;
+    ThreadPool::global().parallel_for((N + chunk_size - 1) / chunk_size, [&](size_t chunk) {
+        size_t end = std::min(N, (chunk + 1) * chunk_size);
+        for (size_t p = chunk * chunk_size; p < end; p++)
+            rng.uniform(0, p * D, points[p].array, -1.0f, 1.0f);
+    });
+
+    return points;
+}
+
+// num_gauss gaussians with points_per_gauss points each. Every gaussian has a mean in [-5, 5) and a sigma in [0.5, 0.8) per dimension, points are ordered by
+// gaussian
+
+template <size_t D>
+std::vector<Vec<float, D>> gaussian_mixture(const Philox& rng, size_t num_gauss, size_t points_per_gauss) {
+    enum Stream : uint64_t { Means, Sigmas, Coordinates };
+
+    std::vector<float> means(num_gauss * D);
+    std::vector<float> sigmas(num_gauss * D);
+    rng.uniform(Means, 0, means, -5.0f, 5.0f);
+    rng.uniform(Sigmas, 0, sigmas, 0.5f, 0.8f);
+
+    std::vector<Vec<float, D>> points(num_gauss * points_per_gauss);
+
+    constexpr size_t chunk_size = 1024;
+    ThreadPool::global().parallel_for((points.size() + chunk_size - 1) / chunk_size, [&](size_t chunk) {
+        size_t begin = chunk * chunk_size;
+        size_t end = std::min(points.size(), begin + chunk_size);
+
+        std::array<float, D> z;
+        for (size_t p = begin; p < end; p++) {
+            rng.normal(Coordinates, p * D, z);
+
+            size_t g = p / points_per_gauss;
+            for (size_t d = 0; d < D; d++)
+                points[p].array[d] = means[g * D + d] + sigmas[g * D + d] * z[d];
+        }
+    });
+
+    return points;
+}
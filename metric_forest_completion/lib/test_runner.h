@@ -1,18 +1,20 @@
 #pragma once
 
-#include <fstream>
+#include <atomic>
+#include <cmath>
 #include <functional>
-#include <future>
 #include <map>
-#include <ostream>
+#include <numeric>
 #include <random>
-#include <set>
 
 #include "../algo/clustering.h"
 #include "../algo/metric_forest_completion.h"
 
 #include "error.h"
 #include "generator.h"
+#include "memory_governor.h"
+#include "result_table.h"
+#include "thread_pool.h"
 
 #define DATA_POINT_LIST                                                                                                                                                                                \
     L(MFC_Cost, mfc_cost, mfc_cost)                                                                                                                                                                    \
@@ -32,8 +34,48 @@
     L(Clustering_Dist_Calls, clustering_dist_calls, (double)mfc.clustering_dist_calls)                                                                                                                 \
     L(Sub_Clustering_Dist_Calls, sub_cluster_dist_calls, (double)mfc.sub_cluster_dist_calls)                                                                                                           \
     L(MFC_Dist_Calls, mfc_dist_calls, (double)mfc.mfc_dist_calls)                                                                                                                                      \
+    L(MFC_Pruned_Dist_Calls, mfc_pruned_dist_calls, (double)mfc.mfc_pruned_dist_calls)                                                                                                                 \
+    L(Scratch_High_Water, scratch_high_water, (double)mfc.scratch_high_water)                                                                                                                          \
+    L(Recursion_Depth, recursion_depth, (double)mfc.recursion_levels.size())                                                                                                                           \
     L(Dist_Calls, dist_calls, (double)(mfc.clustering_dist_calls + mfc.sub_cluster_dist_calls + mfc.mfc_dist_calls))
 
+// Mean and standard deviation of a stream of values, updated in place with Welford's method
+struct RunningStats {
+    size_t count = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    void add(double v) {
+        count++;
+        double delta = v - mean;
+        mean += delta / count;
+        m2 += delta * (v - mean);
+    }
+
+    std::tuple<double, double> stats() const { return {mean, std::sqrt(m2 / count)}; }
+};
+
+// Mean and standard deviation of a list of values, in two passes
+constexpr std::tuple<double, double> compute_stats(const std::vector<double>& vals) {
+    double avg = 0;
+    for (auto v : vals)
+        avg += v;
+    avg /= vals.size();
+    double stddev = 0;
+    for (auto v : vals)
+        stddev += std::pow(v - avg, 2);
+    stddev = std::sqrt(stddev / vals.size());
+    return {avg, stddev};
+}
+
+// Running statistics of every data point of one evaluator
+struct EvaluatorStats {
+
+#define L(NAME, EVAL_VAR, INPUT_VAR) RunningStats EVAL_VAR;
+    DATA_POINT_LIST
+#undef L
+};
+
 // TestHarness, see .cpp files for use
 
 using EvaluatorReturnType = std::generator<std::pair<std::string, std::tuple<Clustering, MetricForestCompletion>>>;
@@ -46,8 +88,8 @@ struct TestRunner {
   public:
     using Evaluator = EvaluatorType<Point, Args...>;
 
-    TestRunner(std::ofstream& out,
-               std::ofstream& all_out,
+    TestRunner(ResultTable out,
+               ResultTable all_out,
                std::default_random_engine random_engine,
                std::array<std::string, sizeof...(Args)> args_headers,
                FDistFunc dist_func,
@@ -61,44 +103,52 @@ struct TestRunner {
     TestRunner(TestRunner&&) = default;
     TestRunner& operator=(TestRunner&&) = default;
 
-    ErrorOr<void> write_headers() {
-
-        std::print(m_out, "N_mu, N_sigma");
-
-        for (auto& s : m_args_headers)
-            std::print(m_out, ", {}", s);
-
-        std::print(m_out,
-                   ", MST_Cost_mu, MST_Cost_sigma"
-                   ", MST_Runtime_mu, MST_Runtime_sigma, RunType");
-        for (auto e : m_evaluators) {
-
-#define L(NAME, EVAL_VAR, INPUT_VAR) std::print(m_out, ", {}_" #NAME "_mu, {}_" #NAME "_sigma", e.first, e.first);
+    // Columns of the averaged results
+    static std::vector<ResultColumn> out_columns(const std::array<std::string, sizeof...(Args)>& args_headers, const std::vector<std::pair<std::string, Evaluator>>& evaluators) {
+        std::vector<ResultColumn> columns = {{"N_mu", ColumnType::Double}, {"N_sigma", ColumnType::Double}};
+        add_args_columns(columns, args_headers);
+        for (auto name : {"MST_Cost_mu", "MST_Cost_sigma", "MST_Runtime_mu", "MST_Runtime_sigma"})
+            columns.push_back({name, ColumnType::Double});
+        columns.push_back({"RunType", ColumnType::Key});
+
+        for (auto& e : evaluators) {
+#define L(NAME, EVAL_VAR, INPUT_VAR)                                                                                                                                                                   \
+    columns.push_back({e.first + "_" #NAME "_mu", ColumnType::Double});                                                                                                                                \
+    columns.push_back({e.first + "_" #NAME "_sigma", ColumnType::Double});
             DATA_POINT_LIST
 #undef L
         }
-        std::print(m_out, "\n");
-        m_out.flush();
 
-        std::print(m_all_out, "N");
-
-        for (auto& s : m_args_headers)
-            std::print(m_all_out, ", {}", s);
+        return columns;
+    }
 
-        std::print(m_all_out, ", MST_Cost, MST_Runtime, RunType");
+    // Columns of the results of every repeat
+    static std::vector<ResultColumn> all_out_columns(const std::array<std::string, sizeof...(Args)>& args_headers, const std::vector<std::pair<std::string, Evaluator>>& evaluators) {
+        std::vector<ResultColumn> columns = {{"N", ColumnType::UInt}};
+        add_args_columns(columns, args_headers);
+        columns.push_back({"MST_Cost", ColumnType::Double});
+        columns.push_back({"MST_Runtime", ColumnType::Double});
+        columns.push_back({"RunType", ColumnType::Key});
 
-        for (auto e : m_evaluators) {
-#define L(NAME, EVAL_VAR, INPUT_VAR) std::print(m_all_out, ", {}_" #NAME, e.first);
+        for (auto& e : evaluators) {
+#define L(NAME, EVAL_VAR, INPUT_VAR) columns.push_back({e.first + "_" #NAME, ColumnType::Double});
             DATA_POINT_LIST
 #undef L
         }
-        std::print(m_all_out, "\n");
-        m_all_out.flush();
 
-        return {};
+        return columns;
     }
 
-    ErrorOr<void> run_test(size_t repeats, const Args&... args) {
+    // Budget in bytes for the tasks of run_test that run at once, 0 for no limit. Only used when multithreading
+    void set_memory_budget(size_t budget) { m_memory_budget = budget; }
+
+    ErrorOr<void> run_test(size_t repeats, const Args&... args) { return run_tests(repeats, {std::tuple<Args...>{args...}}); }
+
+    // Runs every configuration repeats times as one pipeline. Datasets of the next configuration are generated and their MSTs computed while the evaluators of
+    // the current one run, so slow evaluators of one configuration do not leave the pool idle. Every dataset has its own random engine seeded from the runner
+    // and its configuration and repeat index, so the datasets do not depend on scheduling. Rows of a repeat are written once it and every repeat before it are
+    // done, and folded into running statistics that are written at the end of each configuration
+    ErrorOr<void> run_tests(size_t repeats, const std::vector<std::tuple<Args...>>& configs) {
 
         struct EvaulatorResults {
 
@@ -115,145 +165,338 @@ struct TestRunner {
             std::map<std::string, std::vector<EvaulatorResults>> evaluator_res;
         };
 
-        auto execute_test = [&](std::vector<Point> points) -> Results {
-            auto [mst, cur_mst_runtime] = time_code([&]() { return MST_Implicit(points, m_dist_func); });
+        // Statistics of the repeats of one configuration so far
+        struct Summary {
+            RunningStats n;
+            RunningStats mst_cost;
+            RunningStats mst_runtime;
 
-            double cur_mst_cost = 0;
-            for (auto& e : mst)
-                cur_mst_cost += e.weight;
+            std::map<std::string, std::vector<EvaluatorStats>> evaluator_stats;
+        };
 
-            std::map<std::string, std::vector<EvaulatorResults>> evaluator_results;
-            // evaluator_results.reserve(m_evaluators.size());
+        // Work for one repeat. The dataset is generated and its exact MST computed first, every evaluator then runs as its own task and stores its rows in its
+        // own slot
+        struct Repeat {
+            size_t config;
+            size_t index;
+            ErrorOr<void> status;
 
-            for (size_t j = 0; j < m_evaluators.size(); j++) {
+            std::vector<Point> points;
+            size_t n = 0;
+            std::vector<WeightedEdge> mst;
+            double mst_runtime;
+            std::vector<std::vector<std::pair<std::string, EvaulatorResults>>> evaluator_rows;
 
-                for (auto [key_name, evalulator_res] : m_evaluators[j].second(points, args...)) {
-                    auto [clustering, mfc] = std::move(evalulator_res);
+            // Evaluators still running, the points are freed once they are all done
+            std::atomic<size_t> remaining;
+        };
+
+        auto base_seed = m_random_engine();
+
+        auto generate = [&](Repeat& repeat) {
+            std::seed_seq seed{(size_t)base_seed, repeat.config, repeat.index};
+            std::default_random_engine random_engine(seed);
+
+            auto points = std::apply([&](const Args&... args) { return m_dataset_generator(random_engine, args...); }, configs[repeat.config]);
+            if (!points.has_value()) {
+                repeat.status = std::unexpected(std::move(points.error()));
+                return;
+            }
+            repeat.points = std::move(*points);
+            repeat.n = repeat.points.size();
+        };
+
+        auto execute_mst = [&](Repeat& repeat) {
+            auto [mst, cur_mst_runtime] = time_code([&]() {
+                std::vector<size_t> all_indices(repeat.points.size());
+                std::iota(all_indices.begin(), all_indices.end(), 0);
+                return MST_Implicit(repeat.points, all_indices, m_dist_func);
+            });
+            repeat.mst = std::move(mst);
+            repeat.mst_runtime = cur_mst_runtime;
+        };
+
+        auto execute_evaluator = [&](Repeat& repeat, size_t j) {
+            auto& mst = repeat.mst;
+            auto& rows = repeat.evaluator_rows[j];
+
+            // Results are read in place, the cluster forest is shared between every variant of an evaluator
+            auto variants = std::apply([&](const Args&... args) { return m_evaluators[j].second(repeat.points, args...); }, configs[repeat.config]);
+            for (auto&& [key_name, evalulator_res] : variants) {
+                auto& [clustering, mfc] = evalulator_res;
 
-                    double mfc_cluster_weights = 0;
-                    for (auto c : mfc.cluster_edges)
-                        for (auto e : c)
-                            mfc_cluster_weights += e.weight;
+                double mfc_cluster_weights = 0;
+                for (auto& e : mfc.cluster_forest->edges)
+                    mfc_cluster_weights += e.weight;
 
-                    double completion_cost = 0;
-                    for (auto e : mfc.completion_edges)
-                        completion_cost += e.weight;
+                double completion_cost = 0;
+                for (auto& e : mfc.completion_edges)
+                    completion_cost += e.weight;
 
-                    double mfc_cost = mfc_cluster_weights + completion_cost;
+                double mfc_cost = mfc_cluster_weights + completion_cost;
 
-                    auto gamma = [&]() {
-                        double bot = 0;
-                        for (auto e : mst) {
-                            if (clustering.assignments[e.a] == clustering.assignments[e.b]) {
-                                bot += e.weight;
-                            }
+                auto gamma = [&]() {
+                    double bot = 0;
+                    for (auto e : mst) {
+                        if (clustering.assignments[e.a] == clustering.assignments[e.b]) {
+                            bot += e.weight;
                         }
-                        return mfc_cluster_weights / bot;
-                    }();
+                    }
+                    return mfc_cluster_weights / bot;
+                }();
 
-                    std::vector<double> cluster_sizes(mfc.cluster_edges.size(), 0.0);
-                    for (auto v : clustering.assignments)
-                        cluster_sizes[v]++;
-                    auto [cluster_size_mu, cluster_size_sigma] = compute_stats(cluster_sizes);
+                std::vector<double> cluster_sizes(mfc.cluster_forest->cluster_count(), 0.0);
+                for (auto v : clustering.assignments)
+                    cluster_sizes[v]++;
+                auto [cluster_size_mu, cluster_size_sigma] = compute_stats(cluster_sizes);
 
-                    evaluator_results[key_name].push_back(EvaulatorResults{
+                rows.emplace_back(key_name,
+                                  EvaulatorResults{
 #define L(NAME, EVAL_VAR, INPUT_VAR) .EVAL_VAR = INPUT_VAR,
-                        DATA_POINT_LIST
+                                      DATA_POINT_LIST
 #undef L
-                    });
-                }
+                                  });
             }
+        };
+
+        // Rows are collected in evaluator order, so the results do not depend on scheduling
+        auto collect = [&](Repeat& repeat) {
+            double cur_mst_cost = 0;
+            for (auto& e : repeat.mst)
+                cur_mst_cost += e.weight;
+
+            std::map<std::string, std::vector<EvaulatorResults>> evaluator_results;
+            for (auto& rows : repeat.evaluator_rows)
+                for (auto& [key_name, row] : rows)
+                    evaluator_results[key_name].push_back(row);
 
-            return Results{.n = points.size(), .mst_cost = cur_mst_cost, .mst_runtime = cur_mst_runtime, .evaluator_res = evaluator_results};
+            return Results{.n = repeat.n, .mst_cost = cur_mst_cost, .mst_runtime = repeat.mst_runtime, .evaluator_res = evaluator_results};
         };
 
-        auto write_individual_results = [&](std::set<std::string> keys, Results res) {
-            for (auto& key : keys) {
-                std::print(m_all_out, "{}", res.n);
-                (std::print(m_all_out, ", {}", args), ...);
-                std::print(m_all_out, ", {}, {}", res.mst_cost, res.mst_runtime);
-                std::print(m_all_out, ", {}", key);
+        auto add_args = [&](ResultTable& out, const std::tuple<Args...>& config) { std::apply([&](const Args&... args) { (out.add(args), ...); }, config); };
 
-                for (size_t j = 0; j < m_evaluators.size(); j++) {
-                    EvaulatorResults& cur = res.evaluator_res[key][j];
-                    std::print(m_all_out,
-#define L(NAME, EVAL_VAR, INPUT_VAR) ", {}"
-                               DATA_POINT_LIST
-#undef L
+        auto write_individual_results = [&](Results& res, const std::tuple<Args...>& config) {
+            for (auto& [key, rows] : res.evaluator_res) {
+                m_all_out.add(res.n);
+                add_args(m_all_out, config);
+                m_all_out.add(res.mst_cost);
+                m_all_out.add(res.mst_runtime);
+                m_all_out.add(key);
 
-#define L(NAME, EVAL_VAR, INPUT_VAR) , cur.EVAL_VAR
-                                   DATA_POINT_LIST
+                for (size_t j = 0; j < m_evaluators.size(); j++) {
+                    EvaulatorResults& cur = rows[j];
+#define L(NAME, EVAL_VAR, INPUT_VAR) m_all_out.add(cur.EVAL_VAR);
+                    DATA_POINT_LIST
 #undef L
-                    );
                 }
 
-                std::print(m_all_out, "\n");
-                m_all_out.flush();
+                m_all_out.end_row();
             }
         };
 
-        std::vector<Results> results;
+        size_t total = configs.size() * repeats;
+        std::vector<Repeat> repeat_work(total);
+        for (size_t i = 0; i < total; i++) {
+            repeat_work[i].config = i / repeats;
+            repeat_work[i].index = i % repeats;
+            repeat_work[i].evaluator_rows.resize(m_evaluators.size());
+            repeat_work[i].remaining = m_evaluators.size();
+        }
 
-        if constexpr (MultiThread) {
-            std::vector<std::future<Results>> futures;
-            for (size_t i = 0; i < repeats; i++) {
-                auto points = TRY(m_dataset_generator(m_random_engine, args...));
-                futures.push_back(std::async(std::launch::async, execute_test, points));
-            }
-            for (size_t i = 0; i < repeats; i++) {
-                results.push_back(futures[i].get());
-            }
-        } else {
-            for (size_t i = 0; i < repeats; i++) {
-                auto points = TRY(m_dataset_generator(m_random_engine, args...));
-                results.push_back(execute_test(points));
+        // Repeats are finished in order, so the written rows and the statistics do not depend on scheduling
+        Summary summary;
+        size_t finished = 0;
+
+        auto write_summary = [&](size_t c) {
+            for (auto& [key, stats] : summary.evaluator_stats) {
+                auto [n_mu, n_sigma] = summary.n.stats();
+                auto [mst_cost_mu, mst_cost_sigma] = summary.mst_cost.stats();
+                auto [mst_time_mu, mst_time_sigma] = summary.mst_runtime.stats();
+
+                for (double v : {n_mu, n_sigma})
+                    m_out.add(v);
+                add_args(m_out, configs[c]);
+                for (double v : {mst_cost_mu, mst_cost_sigma, mst_time_mu, mst_time_sigma})
+                    m_out.add(v);
+                m_out.add(key);
+
+                for (size_t j = 0; j < m_evaluators.size(); j++) {
+
+                    auto p = [&](std::tuple<double, double> v) {
+                        m_out.add(std::get<0>(v));
+                        m_out.add(std::get<1>(v));
+                    };
+
+#define L(NAME, EVAL_VAR, INPUT_VAR) p(stats[j].EVAL_VAR.stats());
+                    DATA_POINT_LIST
+#undef L
+                }
+                m_out.end_row();
             }
-        }
 
-        std::set<std::string> keys;
-        for (auto& r : results) {
-            for (auto [key, value] : r.evaluator_res)
-                keys.insert(key);
-        }
+            // Rows reach the writer threads once per configuration
+            m_out.flush();
+            m_all_out.flush();
+        };
 
-        for (auto& res : results)
-            write_individual_results(keys, res);
+        // Writes the rows of the next repeat, adds them to the statistics and frees what the repeat held. The statistics are written after the last repeat of a
+        // configuration
+        auto finish_repeat = [&]() {
+            auto& repeat = repeat_work[finished++];
+            auto res = collect(repeat);
+            repeat.mst = {};
+            repeat.evaluator_rows = {};
+
+            write_individual_results(res, configs[repeat.config]);
+
+            summary.n.add(res.n);
+            summary.mst_cost.add(res.mst_cost);
+            summary.mst_runtime.add(res.mst_runtime);
+            for (auto& [key, rows] : res.evaluator_res) {
+                auto& stats = summary.evaluator_stats[key];
+                stats.resize(m_evaluators.size());
+                for (size_t j = 0; j < rows.size() && j < stats.size(); j++) {
+#define L(NAME, EVAL_VAR, INPUT_VAR) stats[j].EVAL_VAR.add(rows[j].EVAL_VAR);
+                    DATA_POINT_LIST
+#undef L
+                }
+            }
 
-        auto extract = [](auto vec, auto f) {
-            std::vector<decltype(f(vec[0]))> res;
-            for (auto& v : vec)
-                res.push_back(f(v));
-            return res;
+            if (repeat.index + 1 == repeats) {
+                write_summary(repeat.config);
+                summary = {};
+            }
         };
 
-        for (auto& key : keys) {
-            auto [n_mu, n_sigma] = compute_stats(extract(results, [](Results& r) { return (double)r.n; }));
-            auto [mst_cost_mu, mst_cost_sigma] = compute_stats(extract(results, [](Results& r) { return r.mst_cost; }));
-            auto [mst_time_mu, mst_time_sigma] = compute_stats(extract(results, [](Results& r) { return r.mst_runtime; }));
+        if constexpr (MultiThread) {
+            // Tasks go to the shared pool, so at most its thread count run at once and their inner loops use the same workers. This thread admits every task
+            // through the memory governor before submitting it, so workers never wait for memory. Evaluators of a repeat are submitted once its MST is done
+            auto& pool = ThreadPool::global();
+            MemoryGovernor governor(m_memory_budget);
+
+            // Estimated peak bytes of one evaluator over n points. The standard evaluators use at least sqrt(n) / 4 clusters, so clusters have up to about
+            // 4 sqrt(n) members. The estimate adds up:
+            // - the evaluator's copy of the points and the permuted copy the layout builds from it
+            // - per point state, 104 bytes rounded up to 128: k-centering's index list, distances and assignments (20), the permuted clustering (12), the layout
+            //   order, position and positions (24), signatures (4), the cluster MSTs, the flat forest and its mapped copy (36), rep generator distances and seeds (8)
+            // - rep generator rows, a float per member for every rep. The largest DP budgets reach past the cluster sizes, so every cluster is extended until it
+            //   is covered, which can take a rep per member
+            // - one cluster MST per thread
+            auto evaluator_footprint = [&](size_t n) {
+                size_t cluster_size = 4 * std::sqrt(n);
+                return n * (2 * sizeof(Point) + 128) + n * cluster_size * sizeof(float) + pool.thread_count() * mst_implicit_footprint(cluster_size);
+            };
+
+            ThreadPool::TaskGroup group;
+            std::vector<ThreadPool::TaskGroup> mst_groups(total);
+            auto wait_all = [&]() {
+                for (auto& mst_group : mst_groups)
+                    pool.wait(mst_group);
+                pool.wait(group);
+            };
+
+            // Datasets are sized once generated, a repeat is admitted with the dataset size of its configuration. The first repeat of a configuration that has
+            // no size yet is a probe: it waits until no other task runs and generates its dataset alone, nothing else is admitted until its size is known. Its MST
+            // is admitted afterwards. Lookahead waits for the size
+            std::vector<std::atomic<size_t>> config_n(configs.size());
+            std::vector<char> probe(total, false);
+            auto repeat_footprint = [&](size_t n) { return n * sizeof(Point) + mst_implicit_footprint(n); };
+
+            // The points of a repeat are held until its last evaluator is done, the generation and MST are a task of their own
+            size_t started = 0;
+            auto start_repeat = [&]() {
+                size_t i = started++;
+                size_t n = config_n[repeat_work[i].config];
+                probe[i] = n == 0;
+                size_t charge = 0;
+                if (probe[i])
+                    governor.admit_alone();
+                else
+                    charge = governor.admit(repeat_footprint(n));
+                pool.submit(mst_groups[i], [&, i, charge]() {
+                    auto& repeat = repeat_work[i];
+                    generate(repeat);
+                    if (repeat.status.has_value()) {
+                        config_n[repeat.config] = repeat.n;
+                        governor.hold(repeat.n * sizeof(Point));
+                        if (!probe[i])
+                            execute_mst(repeat);
+                    }
+                    if (probe[i])
+                        governor.release_alone();
+                    else
+                        governor.release(charge);
+                });
+            };
+
+            for (size_t i = 0; i < total; i++) {
+                // Start this repeat, and the ones after it up to the end of the next configuration while they fit
+                size_t lookahead = std::min(total, (i / repeats + 2) * repeats);
+                auto start_repeats = [&]() {
+                    while (started <= i || (started < lookahead && governor.fits(repeat_footprint(config_n[repeat_work[started].config]))))
+                        start_repeat();
+                };
+                start_repeats();
+
+                auto& repeat = repeat_work[i];
+                pool.wait(mst_groups[i]);
+                if (!repeat.status.has_value()) {
+                    wait_all();
+                    return repeat.status;
+                }
 
-            std::print(m_out, "{}, {}", n_mu, n_sigma);
-            (std::print(m_out, ", {}", args), ...);
-            std::print(m_out, ", {}, {}, {}, {}", mst_cost_mu, mst_cost_sigma, mst_time_mu, mst_time_sigma);
-            std::print(m_out, ", {}", key);
+                // The configuration of a probe is sized now, so the repeats after it can start while its MST runs
+                if (probe[i]) {
+                    size_t charge = governor.admit(mst_implicit_footprint(repeat.n));
+                    pool.submit(mst_groups[i], [&, charge]() {
+                        execute_mst(repeat);
+                        governor.release(charge);
+                    });
+                    start_repeats();
+                    pool.wait(mst_groups[i]);
+                }
 
-            for (size_t j = 0; j < m_evaluators.size(); j++) {
+                for (size_t j = 0; j < m_evaluators.size(); j++) {
+                    size_t charge = governor.admit(evaluator_footprint(repeat.n));
+                    pool.submit(group, [&, j, charge]() {
+                        execute_evaluator(repeat, j);
+                        governor.release(charge);
+
+                        if (--repeat.remaining == 0) {
+                            repeat.points = {};
+                            governor.release_held(repeat.n * sizeof(Point));
+                        }
+                    });
+                }
 
-                auto p = [&](std::tuple<double, double> v) { std::print(m_out, ", {}, {}", std::get<0>(v), std::get<1>(v)); };
+                while (finished <= i && repeat_work[finished].remaining == 0)
+                    finish_repeat();
+            }
+            pool.wait(group);
 
-#define L(NAME, EVAL_VAR, INPUT_VAR) p(compute_stats(extract(results, [&](Results& r) { return r.evaluator_res[key][j].EVAL_VAR; })));
-                DATA_POINT_LIST
-#undef L
+            while (finished < total)
+                finish_repeat();
+        } else {
+            for (size_t c = 0; c < configs.size(); c++) {
+                for (size_t r = 0; r < repeats; r++) {
+                    auto& repeat = repeat_work[c * repeats + r];
+                    generate(repeat);
+                    TRY(repeat.status);
+                    execute_mst(repeat);
+                    for (size_t j = 0; j < m_evaluators.size(); j++)
+                        execute_evaluator(repeat, j);
+                    repeat.points = {};
+                    finish_repeat();
+                }
             }
-            std::print(m_out, "\n");
-            m_out.flush();
         }
 
         return {};
     }
 
   private:
-    std::ofstream m_out;
-    std::ofstream m_all_out;
+    ResultTable m_out;
+    ResultTable m_all_out;
 
     std::array<std::string, sizeof...(Args)> m_args_headers;
 
@@ -263,24 +506,19 @@ struct TestRunner {
 
     std::default_random_engine m_random_engine;
 
+    size_t m_memory_budget = 0;
+
+    static void add_args_columns(std::vector<ResultColumn>& columns, const std::array<std::string, sizeof...(Args)>& args_headers) {
+        size_t i = 0;
+        ((columns.push_back({args_headers[i++], std::is_floating_point_v<Args> ? ColumnType::Double : std::is_integral_v<Args> ? ColumnType::UInt : ColumnType::Key})), ...);
+    }
+
     constexpr static auto time_code(auto f) {
         auto start = std::chrono::high_resolution_clock::now();
         auto res = f();
         auto end = std::chrono::high_resolution_clock::now();
         return std::make_pair(res, std::chrono::duration<double, std::milli>(end - start).count());
     }
-
-    constexpr static std::tuple<double, double> compute_stats(const std::vector<double>& vals) {
-        double avg = 0;
-        for (auto v : vals)
-            avg += v;
-        avg /= vals.size();
-        double stddev = 0;
-        for (auto v : vals)
-            stddev += std::pow(v - avg, 2);
-        stddev = std::sqrt(stddev / vals.size());
-        return {avg, stddev};
-    }
 };
 
 /**
@@ -292,11 +530,12 @@ struct TestRunner {
     FDistFunc - Type of the distance function used
     FDatasetGenerator - Type of the dataset generator function used
     Arguments:
-    results_file - file name for file to write average test results to
-    all_tests_file - file name for file to write individual tests to
+    results_file - file name for file to write average test results to, files ending in .mfcr are written in the binary columnar format of result_table.h and others as CSV
+    all_tests_file - file name for file to write individual tests to, in the same formats
     args_headers - Header names for extra arguments provided to the test function
     dist_func - distance function for points, take two points as arguments and returns a floating point for their distance. Called in parallel when multithreading is enabled
-    dataset_generator - function to generate a new dataset. Is passed a std::default_random_engine& as well as any arguments specified in Args.... Never called in parallel
+    dataset_generator - function to generate a new dataset. Is passed a std::default_random_engine& of its own as well as any arguments specified in Args.... Called in parallel when
+                    multithreading is enabled
     evaluators - a list std::pair<std::string, std::function>. The string is the header prefix to use in the output files, where the function takes a list of points and the Args... and returns a
                     std::generator<std::pair<std::string, std::tuple<Clustering, MetricForestCompletion>>>. Each yeild of this function generates a single line in the output files labled with the key
                     given as the first in the pair. Called in parallel when multithreading is enabled
@@ -309,15 +548,10 @@ CreateTestRunner(std::string results_file,
                  FDistFunc dist_func,
                  FDatasetGenerator dataset_generator,
                  std::vector<std::pair<std::string, typename TestRunner<MultiThread, Point, FDistFunc, FDatasetGenerator, Args...>::Evaluator>> evaluators) {
-    auto out = std::ofstream(results_file);
-    if (!out)
-        return ERR("Failed to open file '" + results_file + "' for writing");
+    using Runner = TestRunner<MultiThread, Point, FDistFunc, FDatasetGenerator, Args...>;
 
-    auto all_out = std::ofstream(all_tests_file);
-    if (!all_out)
-        return ERR("Failed to open file '" + all_tests_file + "' for writing");
+    auto out = TRY(ResultTable::create(results_file, Runner::out_columns(args_headers, evaluators)));
+    auto all_out = TRY(ResultTable::create(all_tests_file, Runner::all_out_columns(args_headers, evaluators)));
 
-    TestRunner<MultiThread, Point, FDistFunc, FDatasetGenerator, Args...> res(out, all_out, std::default_random_engine(std::random_device{}()), args_headers, dist_func, dataset_generator, evaluators);
-    TRY(res.write_headers());
-    return res;
+    return Runner(std::move(out), std::move(all_out), std::default_random_engine(std::random_device{}()), args_headers, dist_func, dataset_generator, evaluators);
 }
\ No newline at end of file
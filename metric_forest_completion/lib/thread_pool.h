@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scratch_arena.h"
+
+// Work stealing thread pool. Every worker owns a queue, idle workers steal from the queues of other workers. Tasks run roughly in submission order, so callers that
+// submit their largest tasks first get largest-first scheduling. A thread waiting on a TaskGroup runs pending tasks of that group, or of groups created inside its
+// tasks, instead of blocking. That makes nested parallel loops (a pool task that itself calls parallel_for) safe, while a waiting task never picks up unrelated
+// work such as another evaluator, so nesting stays as deep as the loops themselves
+
+class ThreadPool {
+  public:
+    // Tracks a set of submitted tasks so they can be waited on together. A group created inside a pool task belongs to the group of that task, and must be waited
+    // on before that task returns
+    struct TaskGroup {
+        std::atomic<size_t> pending = 0;
+        const TaskGroup* parent = t_current_group;
+    };
+
+    explicit ThreadPool(size_t thread_count) : m_queues(std::max<size_t>(thread_count, 1)) {
+        for (size_t i = 0; i < thread_count; i++)
+            m_threads.emplace_back([this, i]() { worker_loop(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto& t : m_threads)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t thread_count() const { return m_threads.size(); }
+
+    void submit(TaskGroup& group, std::function<void()> f) {
+        group.pending++;
+
+        // Tasks submitted from a worker stay on that worker's queue, others are spread round robin
+        size_t queue_index = t_worker_pool == this ? t_worker_index : m_next_queue++ % m_queues.size();
+        m_queued++;
+        {
+            std::lock_guard lock(m_queues[queue_index].mutex);
+            m_queues[queue_index].tasks.push_back(Task{std::move(f), &group, ScratchArena::current_meter()});
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_submitted++;
+        }
+        m_cv.notify_one();
+        m_wait_cv.notify_all();
+    }
+
+    void wait(TaskGroup& group) {
+        size_t home = t_worker_pool == this ? t_worker_index : 0;
+        while (group.pending > 0) {
+            size_t submitted = m_submitted;
+            if (try_run_one(home, &group))
+                continue;
+
+            // Tasks of other groups are left to idle workers, wake up once the group is done or new tasks may belong to it
+            std::unique_lock lock(m_mutex);
+            m_wait_cv.wait(lock, [&]() { return group.pending == 0 || m_submitted != submitted; });
+        }
+    }
+
+    // Runs f(i) for every i in [0, count). Indices are submitted in order
+    template <typename F>
+    void parallel_for(size_t count, F&& f) {
+        if (count == 0)
+            return;
+
+        if (count == 1 || m_threads.empty()) {
+            for (size_t i = 0; i < count; i++)
+                f(i);
+            return;
+        }
+
+        TaskGroup group;
+        for (size_t i = 0; i < count; i++)
+            submit(group, [&f, i]() { f(i); });
+        wait(group);
+    }
+
+    // Pool shared by all algorithms and the test runner, sized to the hardware unless set_global_thread_count was called first
+    static ThreadPool& global() {
+        static ThreadPool pool(global_thread_count());
+        return pool;
+    }
+
+    // Sets the size of the global pool. Only has an effect before the first call to global
+    static void set_global_thread_count(size_t thread_count) { global_thread_count() = std::max<size_t>(thread_count, 1); }
+
+  private:
+    static size_t& global_thread_count() {
+        static size_t thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        return thread_count;
+    }
+
+    struct Task {
+        std::function<void()> f;
+        TaskGroup* group;
+        // Scratch is measured for the meter of the thread that submitted the task
+        ScratchArena::Meter* meter = nullptr;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Whether a task of group runs under within, that is group is within or was created inside a task running under within
+    static bool runs_under(const TaskGroup* group, const TaskGroup* within) {
+        for (; group != nullptr; group = group->parent) {
+            if (group == within)
+                return true;
+        }
+        return false;
+    }
+
+    // Runs the first queued task, or the first one running under within when it is given
+    bool try_run_one(size_t home, const TaskGroup* within = nullptr) {
+        for (size_t i = 0; i < m_queues.size(); i++) {
+            auto& queue = m_queues[(home + i) % m_queues.size()];
+
+            Task task;
+            {
+                std::lock_guard lock(queue.mutex);
+                auto it = within == nullptr ? queue.tasks.begin() : std::ranges::find_if(queue.tasks, [&](const Task& t) { return runs_under(t.group, within); });
+                if (it == queue.tasks.end())
+                    continue;
+                task = std::move(*it);
+                queue.tasks.erase(it);
+            }
+            m_queued--;
+
+            const TaskGroup* outer_group = t_current_group;
+            t_current_group = task.group;
+            {
+                ScratchArena::Meter::Use meter(task.meter);
+                task.f();
+            }
+            t_current_group = outer_group;
+
+            if (--task.group->pending == 0) {
+                std::lock_guard lock(m_mutex);
+                m_wait_cv.notify_all();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void worker_loop(size_t index) {
+        t_worker_pool = this;
+        t_worker_index = index;
+
+        while (true) {
+            if (try_run_one(index))
+                continue;
+
+            std::unique_lock lock(m_mutex);
+            m_cv.wait(lock, [&]() { return m_stop || m_queued > 0; });
+            if (m_stop)
+                return;
+        }
+    }
+
+    std::vector<Queue> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::atomic<size_t> m_queued = 0;
+    std::atomic<size_t> m_next_queue = 0;
+    // Tasks submitted so far, waiting threads look for new tasks of their group whenever it changes
+    std::atomic<size_t> m_submitted = 0;
+
+    std::mutex m_mutex;
+    // Idle workers wait on m_cv for any task, threads in wait on m_wait_cv for their group
+    std::condition_variable m_cv;
+    std::condition_variable m_wait_cv;
+    bool m_stop = false;
+
+    static inline thread_local ThreadPool* t_worker_pool = nullptr;
+    static inline thread_local size_t t_worker_index = 0;
+    // Group of the task running on this thread, nullptr outside of tasks
+    static inline thread_local const TaskGroup* t_current_group = nullptr;
+};
@@ -3,6 +3,8 @@
 #include <array>
 #include <cmath>
 #include <print>
+#include <span>
+#include <vector>
 
 // General purpose n dimensional templated vector type
 
@@ -127,4 +129,52 @@ struct std::formatter<Vec<T, N>> : std::formatter<T> {
         });
         return format_to(ctx.out(), "]");
     }
+};
+
+// Euclidean distance between two vectors. Implements the batched dist_many interface from algo/distance.h for full rows, prefetching the next point while the current one is computed,
+// and dist_bounded, which abandons the sum of squares once it passes upper^2. The lower bound |‖a‖ - ‖b‖| comes from the norms
+template <typename Vec>
+struct EuclideanDistance {
+    constexpr float operator()(const Vec& a, const Vec& b) const { return (b - a).length(); }
+
+    using Signature = float;
+
+    Signature signature(const Vec& p) const { return p.length(); }
+    // Slack proportional to the norms, so rounding in either norm never puts the bound above the computed distance
+    float lower_bound(const Signature& a, const Signature& b) const { return std::abs(a - b) - 1e-4f * (a + b); }
+
+    float dist_bounded(const Vec& a, const Vec& b, float upper) const {
+        constexpr size_t dims = sizeof(a.array) / sizeof(a.array[0]);
+        constexpr size_t block = 32;
+
+        // Low dimensions are cheaper to compute in full than to check
+        if constexpr (dims < 2 * block) {
+            return (*this)(a, b);
+        } else {
+            // Slack on the bound so rounding in the partial sum never abandons a distance that is below upper
+            auto bound = (double)upper * upper * (1.0 + 1e-5);
+
+            typename Vec::Type sum = 0;
+            for (size_t start = 0; start < dims; start += block) {
+                for (size_t i = start; i < std::min(start + block, dims); i++) {
+                    auto d = b.array[i] - a.array[i];
+                    sum += d * d;
+                }
+                if (sum > bound)
+                    return INFINITY;
+            }
+            return std::sqrt(sum);
+        }
+    }
+
+    void dist_many(const Vec& query, const std::vector<Vec>& points, std::span<const size_t> indices, std::span<float> out) const {
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (i + 1 < indices.size()) {
+                auto next = reinterpret_cast<const char*>(&points[indices[i + 1]]);
+                for (size_t offset = 0; offset < sizeof(Vec); offset += 64)
+                    __builtin_prefetch(next + offset);
+            }
+            out[i] = (points[indices[i]] - query).length();
+        }
+    }
 };
\ No newline at end of file
@@ -0,0 +1,16 @@
+#include "lib/error.h"
+#include "lib/result_table.h"
+
+#include <cstdio>
+#include <print>
+
+// Converts a binary .mfcr results file to the CSV the test runner writes for other file names, for the plotting scripts
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::print("Usage: {} [results.mfcr] [output.csv]\n", argv[0]);
+        return 1;
+    }
+
+    MUST(results_to_csv(argv[1], argv[2]));
+}
@@ -0,0 +1,108 @@
+#include "../algo/ball_tree.h"
+#include "../lib/error.h"
+#include "../lib/vec.h"
+
+#include <random>
+
+// Checks the ball tree searches against brute force scans. Points sit on a small integer grid so many distances tie, which exercises the tie breaking
+
+using Point = Vec<float, 2>;
+
+std::vector<Point> grid_points(std::mt19937& random_engine, size_t count) {
+    std::uniform_int_distribution<int> coordinate(0, 12);
+    std::vector<Point> points(count);
+    for (auto& p : points)
+        p = Point{{(float)coordinate(random_engine), (float)coordinate(random_engine)}};
+    return points;
+}
+
+void check_closest_pair(std::mt19937& random_engine, size_t size_a, size_t size_b, size_t leaf_size) {
+    EuclideanDistance<Point> dist_func;
+    auto points = grid_points(random_engine, size_a + size_b);
+
+    std::vector<size_t> indices(points.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::shuffle(indices.begin(), indices.end(), random_engine);
+    auto cluster_a = std::span<const size_t>(indices).first(size_a);
+    auto cluster_b = std::span<const size_t>(indices).subspan(size_a);
+
+    auto tree_a = build_ball_tree(points, cluster_a, dist_func, leaf_size);
+    auto tree_b = build_ball_tree(points, cluster_b, dist_func, leaf_size);
+    auto [a, b, dist] = closest_pair(points, cluster_a, tree_a, cluster_b, tree_b, dist_func);
+
+    // A scan over a and then b keeps the first pair with the smallest distance
+    size_t best_a = 0;
+    size_t best_b = 0;
+    float best = INFINITY;
+    for (size_t i = 0; i < size_a; i++) {
+        for (size_t j = 0; j < size_b; j++) {
+            float d = dist_func(points[cluster_a[i]], points[cluster_b[j]]);
+            if (d < best) {
+                best = d;
+                best_a = i;
+                best_b = j;
+            }
+        }
+    }
+
+    REQUIRE(dist == best && a == best_a && b == best_b,
+            "closest_pair returned (%zu, %zu, %f), expected (%zu, %zu, %f) for sizes %zu, %zu and leaf size %zu",
+            a,
+            b,
+            dist,
+            best_a,
+            best_b,
+            best,
+            size_a,
+            size_b,
+            leaf_size);
+}
+
+void check_nearest_members(std::mt19937& random_engine, size_t size, size_t leaf_size) {
+    EuclideanDistance<Point> dist_func;
+    auto points = grid_points(random_engine, size + 1);
+    auto query = points.back();
+
+    std::vector<size_t> cluster(size);
+    std::iota(cluster.begin(), cluster.end(), 0);
+    auto tree = build_ball_tree(points, cluster, dist_func, leaf_size);
+
+    std::uniform_int_distribution<size_t> label(0, 2);
+    std::vector<size_t> labels(size);
+    for (auto& l : labels)
+        l = label(random_engine);
+    auto labels_of_nodes = node_labels(tree, labels);
+
+    for (bool exclude : {false, true}) {
+        std::vector<std::pair<float, size_t>> expected;
+        for (size_t i = 0; i < size; i++) {
+            if (!exclude || labels[i] != 1)
+                expected.emplace_back(dist_func(query, points[cluster[i]]), i);
+        }
+        std::ranges::sort(expected);
+
+        for (size_t m : {(size_t)1, (size_t)5, size + 3}) {
+            std::optional<ExcludedLabel> excluded;
+            if (exclude)
+                excluded = ExcludedLabel{labels, labels_of_nodes, 1};
+            auto res = nearest_members(points, cluster, tree, query, m, dist_func, excluded);
+
+            auto want = std::span(expected).first(std::min(m, expected.size()));
+            REQUIRE(std::ranges::equal(res, want), "nearest_members differs from a sorted scan for size %zu, leaf size %zu, m %zu, exclude %d", size, leaf_size, m, exclude);
+        }
+    }
+}
+
+int main() {
+    std::mt19937 random_engine(7);
+
+    for (size_t leaf_size : {1, 4, 16}) {
+        for (size_t size_a : {1, 2, 17, 150}) {
+            for (size_t size_b : {1, 9, 200})
+                check_closest_pair(random_engine, size_a, size_b, leaf_size);
+        }
+
+        for (size_t size : {1, 2, 33, 400})
+            check_nearest_members(random_engine, size, leaf_size);
+    }
+}
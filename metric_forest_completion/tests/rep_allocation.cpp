@@ -0,0 +1,88 @@
+#include "../algo/rep_allocation.h"
+#include "../lib/error.h"
+
+#include <random>
+
+// Checks allocate_reps_dp against every possible allocation on small inputs. Costs are small integers, so sums are exact and any optimal allocation has the
+// same cost as the best one found by enumeration
+
+using Curve = std::vector<std::pair<size_t, float>>;
+
+// Non-increasing cost curve of a cluster with up to max_size reps. Convex curves take the divide and conquer path of the DP, the others the full search. A curve
+// shorter than the budget belongs to a cluster that is covered early
+Curve random_curve(std::mt19937& random_engine, size_t max_size, bool convex) {
+    size_t size = std::uniform_int_distribution<size_t>(0, max_size)(random_engine);
+
+    std::vector<float> decreases(size == 0 ? 0 : size - 1);
+    for (auto& d : decreases)
+        d = std::uniform_int_distribution<int>(0, 6)(random_engine);
+    if (convex)
+        std::ranges::sort(decreases, std::greater{});
+
+    Curve curve;
+    float cost = std::uniform_int_distribution<int>(10, 60)(random_engine);
+    for (size_t r = 0; r < size; r++) {
+        curve.emplace_back(r, cost);
+        if (r < decreases.size())
+            cost = std::max(0.0f, cost - decreases[r]);
+    }
+    return curve;
+}
+
+// Cost of a cluster with count reps, a covered cluster stays at its last cost
+float curve_cost(const Curve& curve, size_t count) {
+    if (curve.empty())
+        return 0;
+    return curve[std::min(std::max<size_t>(count, 1), curve.size()) - 1].second;
+}
+
+// Lowest cost over every way to hand out at most budget extra reps
+float best_cost(const std::vector<Curve>& curves, size_t t, size_t budget) {
+    if (t == curves.size())
+        return 0;
+
+    float best = INFINITY;
+    for (size_t extra = 0; extra <= budget; extra++)
+        best = std::min(best, curve_cost(curves[t], extra + 1) + best_cost(curves, t + 1, budget - extra));
+    return best;
+}
+
+void check(std::mt19937& random_engine, size_t cluster_count, size_t budget) {
+    std::vector<Curve> curves;
+    for (size_t t = 0; t < cluster_count; t++)
+        curves.push_back(random_curve(random_engine, budget + 1, random_engine() % 2 == 0));
+
+    std::vector<std::span<const std::pair<size_t, float>>> spans(curves.begin(), curves.end());
+    auto counts = allocate_reps_dp(spans, budget);
+
+    REQUIRE(counts.size() == cluster_count, "Expected %zu counts, got %zu", cluster_count, counts.size());
+
+    size_t extra = 0;
+    float cost = 0;
+    for (size_t t = 0; t < cluster_count; t++) {
+        REQUIRE(counts[t] >= std::min<size_t>(curves[t].size(), 1) && counts[t] <= curves[t].size(), "Cluster %zu got %zu reps of %zu", t, counts[t], curves[t].size());
+        extra += counts[t] - std::min<size_t>(counts[t], 1);
+        cost += curve_cost(curves[t], counts[t]);
+    }
+
+    float expected = best_cost(curves, 0, budget);
+    REQUIRE(extra <= budget, "Allocated %zu extra reps with a budget of %zu", extra, budget);
+    REQUIRE(cost == expected, "Allocation costs %f, the best allocation costs %f for %zu clusters and a budget of %zu", cost, expected, cluster_count, budget);
+}
+
+int main() {
+    std::mt19937 random_engine(11);
+
+    for (size_t cluster_count = 1; cluster_count <= 4; cluster_count++) {
+        for (size_t budget = 0; budget <= 12; budget++) {
+            for (size_t i = 0; i < 20; i++)
+                check(random_engine, cluster_count, budget);
+        }
+    }
+
+    // Budgets above the chunk size of the parallel search
+    for (size_t budget : {63, 64, 65, 100}) {
+        for (size_t i = 0; i < 10; i++)
+            check(random_engine, 3, budget);
+    }
+}
@@ -0,0 +1,69 @@
+#include "../lib/error.h"
+#include "../lib/result_table.h"
+
+#include <random>
+
+// Checks that a binary results table converted with results_to_csv is byte for byte the CSV the same rows are written as directly. Rows span several row groups,
+// including a short group from a flush, and the doubles include values whose shortest round trip form is long
+
+std::string read_all(const std::string& path) {
+    auto file = MUST(load_file(path));
+    return std::string(reinterpret_cast<const char*>(file.buffer.get()), file.size);
+}
+
+int main() {
+    auto dir = std::filesystem::temp_directory_path();
+    std::string csv_file = dir / "mfc_test_result_table.csv";
+    std::string binary_file = dir / "mfc_test_result_table.mfcr";
+    std::string converted_file = dir / "mfc_test_result_table_converted.csv";
+
+    std::vector<ResultColumn> columns = {
+        {"Evaluator", ColumnType::Key},
+        {"Dataset_Size", ColumnType::UInt},
+        {"Cost", ColumnType::Double},
+        {"Dist_Calls", ColumnType::UInt},
+        {"Runtime", ColumnType::Double},
+    };
+
+    auto csv = MUST(ResultTable::create(csv_file, columns));
+    auto binary = MUST(ResultTable::create(binary_file, columns));
+
+    std::mt19937_64 random_engine(5);
+    std::vector<double> special = {0.0, -0.0, 0.1, 1.0 / 3.0, 1e-300, 1e300, -2.5, 123456789.125, std::numeric_limits<double>::denorm_min()};
+    const char* evaluators[] = {"Exact", "Fixed_Reps_1", "Greedy_Reps", "DP_Reps", ""};
+
+    for (size_t r = 0; r < 3 * ResultTable::row_group_size + 41; r++) {
+        auto evaluator = evaluators[r % std::size(evaluators)];
+        uint64_t size = r == 0 ? std::numeric_limits<uint64_t>::max() : random_engine() >> (r % 64);
+        double cost = r < special.size() ? special[r] : std::uniform_real_distribution<double>(-1e6, 1e6)(random_engine);
+        uint64_t dist_calls = r;
+        float runtime = std::uniform_real_distribution<float>(0, 10)(random_engine);
+
+        for (auto* table : {&csv, &binary}) {
+            table->add(evaluator);
+            table->add(size);
+            table->add(cost);
+            table->add(dist_calls);
+            table->add(runtime);
+            table->end_row();
+        }
+
+        // The runner flushes after every evaluated dataset, which leaves short row groups
+        if (r == 100) {
+            csv.flush();
+            binary.flush();
+        }
+    }
+
+    MUST(csv.close());
+    MUST(binary.close());
+    MUST(results_to_csv(binary_file, converted_file));
+
+    auto expected = read_all(csv_file);
+    auto converted = read_all(converted_file);
+    REQUIRE(converted == expected, "Converted results differ from the CSV written directly, %zu bytes against %zu", converted.size(), expected.size());
+
+    std::filesystem::remove(csv_file);
+    std::filesystem::remove(binary_file);
+    std::filesystem::remove(converted_file);
+}
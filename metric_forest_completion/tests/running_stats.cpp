@@ -0,0 +1,48 @@
+#include "../lib/error.h"
+#include "../lib/test_runner.h"
+
+#include <random>
+
+// Checks the running statistics the test runner aggregates repeats with against the two pass compute_stats over the same values
+
+void check(const std::vector<double>& values, const char* name) {
+    RunningStats running;
+    for (auto v : values)
+        running.add(v);
+
+    auto [mean, sigma] = running.stats();
+    auto [expected_mean, expected_sigma] = compute_stats(values);
+
+    // Both are exact up to rounding, which grows with the size of the values rather than with their spread
+    double scale = 0;
+    for (auto v : values)
+        scale = std::max(scale, std::abs(v));
+    double tolerance = 1e-12 * std::max(scale, 1.0);
+
+    REQUIRE(running.count == values.size(), "%s: counted %zu values of %zu", name, running.count, values.size());
+    REQUIRE(std::abs(mean - expected_mean) <= tolerance, "%s: mean %.17g, expected %.17g", name, mean, expected_mean);
+    REQUIRE(std::abs(sigma - expected_sigma) <= tolerance + 1e-9 * expected_sigma, "%s: sigma %.17g, expected %.17g", name, sigma, expected_sigma);
+}
+
+int main() {
+    std::mt19937 random_engine(3);
+
+    check({42}, "single value");
+    check({5, 5, 5, 5}, "constant values");
+    check({1, 2, 3, 4, 5, 6, 7, 8, 9, 10}, "small integers");
+
+    for (size_t count : {1, 2, 3, 16, 100, 1000}) {
+        std::vector<double> normal;
+        std::normal_distribution<double> normal_distribution(3, 0.5);
+        for (size_t i = 0; i < count; i++)
+            normal.push_back(normal_distribution(random_engine));
+        check(normal, "normal values");
+
+        // Large values with a small spread, such as distance call counts, where a naive sum of squares loses the spread
+        std::vector<double> offset;
+        std::uniform_int_distribution<int> noise(-1000, 1000);
+        for (size_t i = 0; i < count; i++)
+            offset.push_back(1e9 + noise(random_engine));
+        check(offset, "offset values");
+    }
+}
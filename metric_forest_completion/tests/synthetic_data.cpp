@@ -0,0 +1,82 @@
+#include "../lib/error.h"
+#include "../lib/philox.h"
+#include "../lib/synthetic_data.h"
+
+#include <cstdlib>
+
+// Checks Philox against the known answers of the Random123 reference, and that synthetic datasets generated on the pool equal the same values generated one
+// point at a time. Run with the pool size as its argument, ctest runs it with several
+
+void check_known_answers() {
+    struct KnownAnswer {
+        uint64_t key;
+        uint64_t stream;
+        uint64_t counter;
+        std::array<uint32_t, 4> block;
+    };
+
+    // Counter words {counter, counter >> 32, stream, stream >> 32} and key words {key, key >> 32}
+    KnownAnswer answers[] = {
+        {0, 0, 0, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {~0ull, ~0ull, ~0ull, {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {0x299f31d0a4093822, 0x0370734413198a2e, 0x85a308d3243f6a88, {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+    };
+
+    for (auto& answer : answers)
+        REQUIRE(Philox(answer.key).block(answer.stream, answer.counter) == answer.block, "Philox block differs from the known answer for key %llx", (unsigned long long)answer.key);
+}
+
+void check_ranges() {
+    Philox rng(42);
+
+    // Any range of a stream holds the same values as the whole stream
+    std::vector<float> whole(37);
+    rng.normal(3, 5, whole);
+    for (size_t first = 0; first < whole.size(); first++) {
+        for (size_t size = 0; first + size <= whole.size(); size += 3) {
+            std::vector<float> part(size);
+            rng.normal(3, 5 + first, part);
+            REQUIRE(std::ranges::equal(part, std::span(whole).subspan(first, size)), "Stream range at %zu of size %zu differs", first, size);
+        }
+    }
+}
+
+template <size_t D>
+void check_datasets() {
+    Philox rng(7);
+
+    auto uniform = uniform_points<D>(rng, 5000);
+    for (size_t p = 0; p < uniform.size(); p++) {
+        std::array<float, D> expected;
+        rng.uniform(0, p * D, expected, -1.0f, 1.0f);
+        REQUIRE(uniform[p].array == expected, "Uniform point %zu differs from the point generated alone", p);
+    }
+
+    size_t num_gauss = 7;
+    size_t points_per_gauss = 700;
+    auto mixture = gaussian_mixture<D>(rng, num_gauss, points_per_gauss);
+
+    std::vector<float> means(num_gauss * D);
+    std::vector<float> sigmas(num_gauss * D);
+    rng.uniform(0, 0, means, -5.0f, 5.0f);
+    rng.uniform(1, 0, sigmas, 0.5f, 0.8f);
+    for (size_t p = 0; p < mixture.size(); p++) {
+        std::array<float, D> z;
+        rng.normal(2, p * D, z);
+
+        size_t g = p / points_per_gauss;
+        for (size_t d = 0; d < D; d++)
+            REQUIRE(mixture[p].array[d] == means[g * D + d] + sigmas[g * D + d] * z[d], "Gaussian point %zu differs from the point generated alone", p);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1)
+        ThreadPool::set_global_thread_count(atoi(argv[1]));
+
+    check_known_answers();
+    check_ranges();
+    check_datasets<2>();
+    check_datasets<3>();
+    check_datasets<16>();
+}
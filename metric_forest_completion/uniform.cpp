@@ -1,6 +1,7 @@
 #include <cfloat>
 
 #include "lib/args.h"
+#include "lib/synthetic_data.h"
 #include "lib/test_runner.h"
 #include "lib/vec.h"
 
@@ -14,7 +15,7 @@ struct {
     std::string input_file;
     std::string output_file;
     std::string all_output_file;
-    bool cluster_test = false;
+    StandardOptions options;
     int dim;
 } args;
 
@@ -24,32 +25,20 @@ void test_dim() {
     using Vec = Vec<float, D>;
 
     // Euclidean distance
-    constexpr static auto dist_func = [](const Vec& a, const Vec& b) { return (b - a).length(); };
+    constexpr static auto dist_func = EuclideanDistance<Vec>{};
 
     // Generate function for test runner. Generates N points
-    auto gen_dataset = [&](std::default_random_engine& re, size_t N) -> ErrorOr<std::vector<Vec>> {
-        std::vector<Vec> points;
-        points.reserve(N);
-        std::uniform_real_distribution<> random_dist(-1, 1);
-
-        for (int i = 0; i < N; i++) {
-            std::array<float, D> v;
-            for (int i = 0; i < D; i++)
-                v[i] = (float)random_dist(re);
-            points.push_back(Vec{v});
-        }
-        return points;
-    };
+    auto gen_dataset = [&](std::default_random_engine& re, size_t N) -> ErrorOr<std::vector<Vec>> { return uniform_points<D>(Philox::from_engine(re), N); };
 
     // Run standard set of evalulators
-    run_standard_evalulators<Vec>(args.output_file, args.all_output_file, args.cluster_test, gen_dataset, dist_func);
+    run_standard_evalulators<Vec>(args.output_file, args.all_output_file, args.options, gen_dataset, dist_func);
 }
 
 int main(int argc, char** argv) {
     REQUIRE(parse_arg(argc, argv, "dimension", args.dim, 'd'), "");
     REQUIRE(parse_arg(argc, argv, "output_file", args.output_file, 'o'), "");
     REQUIRE(parse_arg(argc, argv, "all_output_file", args.all_output_file, 'a'), "");
-    REQUIRE(parse_arg(argc, argv, "cluster_test", args.cluster_test, 'c', false), "");
+    REQUIRE(parse_standard_options(argc, argv, args.options), "");
 
 #define DIM(D)                                                                                                                                                                                         \
     case D:                                                                                                                                                                                            \